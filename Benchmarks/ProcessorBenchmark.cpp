@@ -0,0 +1,540 @@
+/*
+  ==============================================================================
+
+    ProcessorBenchmark.cpp
+    Headless benchmark for MyGreatProjectAudioProcessor.
+
+    Runs prepareToPlay/processBlock on synthetic audio over a grid of sample
+    rates, block sizes, channel layouts, delay lengths, feedback values and
+    both precisions (float and double buffers), and prints the cost of each
+    case as a table. The default grid takes a few minutes: one
+    rate, delay and feedback, three block sizes and three bus widths.
+
+    Besides the delay, multi-tap, reverb and granular engines, delayCC is the
+    delay with a controller message every 8 samples (what splitting blocks at
+    MIDI events costs), idle is the delay fed silence (an unused send once it
+    has stopped processing) and tape is the delay with the colour stage on.
+
+    Realtime cases on buses the processor splits over its worker threads (16
+    channels and up) run a second time with splitWideBuses off; the table
+    shows the speedup, and a summary gives the block size from which
+    splitting pays off for each bus width. The benchmark also times creating
+    and destroying many instances, as a host does while scanning plug-ins or
+    loading a session.
+
+    Usage: MyGreatProject_Benchmark [options]
+        --full                sweep every axis (tens of thousands of cases, hours)
+        --engine <names>      run only these engines (comma-separated)
+        --rate <Hz>           sample rates to run (comma-separated)
+        --channels <n>        bus widths to run (comma-separated)
+        --seconds <s>         audio per case (default 2)
+        --instances <n>       instances to create and destroy (default 200)
+        --format float32|int16|bfloat16
+                              delay line storage format
+        --chunk <samples>     the processor's chunk size
+        --isa baseline|avx2|avx512
+                              cap the instruction set the kernels are picked for
+        --offline             run every case as an offline render (4x colour
+                              stage, channel groups over the render threads)
+        --json <file>         write the results as JSON
+        --trace <file>        trace the last case with the DSP load profiler,
+                              as Chrome trace JSON (ui.perfetto.dev)
+        --self-test           run the processor's self-test instead, then exit
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../Source/PluginProcessor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <type_traits>
+
+namespace
+{
+    constexpr int wideBusChannels = 16;   //the narrowest bus the processor splits in realtime (REALTIME_PARALLEL_MIN_CHANNELS)
+    constexpr double paysOffSpeedup = 1.1;
+
+    //which engine a case runs; the name is what ends up in the report
+    struct Engine
+    {
+        const char* name;
+        MyGreatProjectAudioProcessor::Mode mode;
+        int size;               //taps in multi-tap mode, lines in reverb mode, grains in flight in granular mode
+        int controllerInterval; //samples between MIDI CC messages in every block, 0 for none
+        bool silentInput;       //feed silence instead of noise, once the line has been filled
+        bool coloured;          //tone and drive on, so the send goes through the colour stage
+    };
+
+    const Engine engines[] = {
+        { "delay",     MyGreatProjectAudioProcessor::Mode::delay,    0,                  0, false, false },
+        { "delayCC",   MyGreatProjectAudioProcessor::Mode::delay,    0,                  8, false, false },
+        { "idle",      MyGreatProjectAudioProcessor::Mode::delay,    0,                  0, true,  false },
+        { "tape",      MyGreatProjectAudioProcessor::Mode::delay,    0,                  0, false, true  },
+        { "taps32",    MyGreatProjectAudioProcessor::Mode::multiTap, DelayLine::maxTaps, 0, false, false },
+        { "fdn8",      MyGreatProjectAudioProcessor::Mode::reverb,   8,                  0, false, false },
+        { "fdn16",     MyGreatProjectAudioProcessor::Mode::reverb,   16,                 0, false, false },
+        { "grains32",  MyGreatProjectAudioProcessor::Mode::granular, 32,                 0, false, false },
+        { "grains256", MyGreatProjectAudioProcessor::Mode::granular, GranularDelay::maxGrains, 0, false, false },
+    };
+
+    struct BenchmarkCase
+    {
+        double sampleRate;
+        int blockSize;
+        int numChannels;
+        float delaySeconds;
+        float feedback;
+        Engine engine;
+        bool doublePrecision;   //which processBlock overload the case runs
+    };
+
+    struct BenchmarkResult
+    {
+        BenchmarkCase config;
+        int numBlocks;
+        double nsPerSample;     //per channel-sample
+        double realtimeFactor;  //seconds of audio processed per second of CPU
+        double p50Micros, p99Micros, maxMicros;
+        size_t memoryBytes;     //sample memory held by the instance
+        int chunkSize;          //samples the processor handles at a time
+        double speedup;         //against the same case with splitWideBuses off, 0 where it wasn't compared
+    };
+
+    struct ConstructionResult
+    {
+        int numInstances;
+        double constructMicros; //mean per instance
+        double destroyMicros;
+    };
+
+    struct Options
+    {
+        bool full = false;
+        std::vector<std::string> engineNames; //empty: every engine
+        std::vector<double> sampleRates;      //empty: the grid's own
+        std::vector<int> channelCounts;
+        bool selfTest = false;
+        bool offline = false;
+        double secondsOfAudio = 2.0;
+        int numInstances = 200;
+        SampleFormat format = SampleFormat::float32;
+        int chunkSize = 0; //0 leaves the processor's default
+        InstructionSet instructionSet = InstructionSet::avx512; //a cap: the best the CPU supports, up to this
+        juce::String jsonPath;
+        juce::String tracePath;
+    };
+
+    //"a,b,c" -> { "a", "b", "c" }
+    std::vector<std::string> splitList (const char* list) {
+        std::vector<std::string> items;
+        std::stringstream stream (list);
+        for (std::string item; std::getline (stream, item, ',');)
+            if (! item.empty())
+                items.push_back (item);
+        return items;
+    }
+
+    Options parseOptions (int argc, char* argv[]) {
+        Options options;
+        for (int i = 1; i < argc; ++i) {
+            const juce::String arg (argv[i]);
+            if (arg == "--full")
+                options.full = true;
+            else if (arg == "--quick")
+                options.full = false; //the default; still accepted for older scripts
+            else if (arg == "--engine" && i + 1 < argc)
+                options.engineNames = splitList (argv[++i]);
+            else if (arg == "--rate" && i + 1 < argc) {
+                for (const auto& rate : splitList (argv[++i]))
+                    options.sampleRates.push_back (std::atof (rate.c_str()));
+            }
+            else if (arg == "--channels" && i + 1 < argc) {
+                for (const auto& count : splitList (argv[++i]))
+                    options.channelCounts.push_back (std::max (1, std::atoi (count.c_str())));
+            }
+            else if (arg == "--seconds" && i + 1 < argc)
+                options.secondsOfAudio = juce::String (argv[++i]).getDoubleValue();
+            else if (arg == "--instances" && i + 1 < argc)
+                options.numInstances = std::max (1, juce::String (argv[++i]).getIntValue());
+            else if (arg == "--json" && i + 1 < argc)
+                options.jsonPath = argv[++i];
+            else if (arg == "--trace" && i + 1 < argc)
+                options.tracePath = argv[++i];
+            else if (arg == "--format" && i + 1 < argc) {
+                const juce::String name (argv[++i]);
+                options.format = name == "int16"    ? SampleFormat::int16
+                               : name == "bfloat16" ? SampleFormat::bfloat16
+                                                    : SampleFormat::float32;
+            }
+            else if (arg == "--chunk" && i + 1 < argc)
+                options.chunkSize = juce::String (argv[++i]).getIntValue();
+            else if (arg == "--isa" && i + 1 < argc) {
+                const juce::String name (argv[++i]);
+                options.instructionSet = name == "baseline" ? InstructionSet::baseline
+                                       : name == "avx2"     ? InstructionSet::avx2
+                                                            : InstructionSet::avx512;
+            }
+            else if (arg == "--offline")
+                options.offline = true;
+            else if (arg == "--self-test")
+                options.selfTest = true;
+        }
+        return options;
+    }
+
+    std::vector<BenchmarkCase> makeGrid (const Options& options) {
+        const bool quick = ! options.full;
+        std::vector<double> sampleRates = quick ? std::vector<double> { 48000.0 }
+                                                : std::vector<double> { 44100.0, 48000.0, 96000.0, 192000.0 };
+        const std::vector<int> blockSizes = quick ? std::vector<int> { 64, 512, 4096 }
+                                                  : std::vector<int> { 16, 64, 256, 1024, 4096, 8192 };
+        //mono, stereo, 5.1, 7.1.4, third-order ambisonics, a bus of 64 objects
+        std::vector<int> channelCounts = quick ? std::vector<int> { 2, 16, 64 }
+                                               : std::vector<int> { 1, 2, 6, 12, 16, 64 };
+        if (! options.sampleRates.empty())
+            sampleRates = options.sampleRates;
+        if (! options.channelCounts.empty())
+            channelCounts = options.channelCounts;
+        const std::vector<float> delays = quick ? std::vector<float> { 0.25f }
+                                                : std::vector<float> { 0.001f, 0.25f, 4.0f };
+        const std::vector<float> feedbacks = quick ? std::vector<float> { 0.5f }
+                                                   : std::vector<float> { 0.0f, 0.5f, 0.95f };
+
+        std::vector<BenchmarkCase> grid;
+        for (auto rate : sampleRates)
+            for (auto block : blockSizes)
+                for (auto channels : channelCounts)
+                    for (auto delay : delays)
+                        for (auto fb : feedbacks)
+                            for (const auto& engine : engines)
+                                for (const bool doublePrecision : { false, true })
+                                    if (options.engineNames.empty()
+                                        || std::find (options.engineNames.begin(), options.engineNames.end(), engine.name) != options.engineNames.end())
+                                        grid.push_back ({ rate, block, channels, delay, fb, engine, doublePrecision });
+        return grid;
+    }
+
+    double percentile (std::vector<double>& sorted, double p) {
+        if (sorted.empty())
+            return 0.0;
+        const auto index = static_cast<size_t> (p * static_cast<double> (sorted.size() - 1) + 0.5);
+        return sorted[index];
+    }
+
+    const char* getFormatName (SampleFormat format) {
+        switch (format) {
+            case SampleFormat::int16:    return "int16";
+            case SampleFormat::bfloat16: return "bfloat16";
+            case SampleFormat::float32:
+            default:                     return "float32";
+        }
+    }
+
+    template <typename SampleType>
+    BenchmarkResult runCase (const BenchmarkCase& config, const Options& options, const juce::File& traceFile,
+                             bool splitWideBuses = true) {
+        MyGreatProjectAudioProcessor processor;
+        processor.splitWideBuses = splitWideBuses;
+        processor.setProcessingPrecision (std::is_same_v<SampleType, double> ? juce::AudioProcessor::doublePrecision
+                                                                             : juce::AudioProcessor::singlePrecision);
+        processor.setStorageFormat (options.format);
+        if (options.chunkSize > 0)
+            processor.setChunkSize (options.chunkSize);
+        const bool tracing = traceFile != juce::File();
+        processor.profiler.setEnabled (tracing);
+        processor.profiler.setTracing (tracing);
+
+        const auto channelSet = juce::AudioChannelSet::discreteChannels (config.numChannels);
+        juce::AudioProcessor::BusesLayout layout;
+        layout.inputBuses.add (channelSet);
+        layout.outputBuses.add (channelSet);
+        processor.setBusesLayout (layout);
+        processor.setRateAndBufferSizeDetails (config.sampleRate, config.blockSize);
+
+        processor.setDelayLength (config.delaySeconds);
+        processor.setDelayFeedback (config.feedback);
+        processor.setMode (config.engine.mode);
+        if (config.engine.mode == MyGreatProjectAudioProcessor::Mode::multiTap) {
+            //spread the taps evenly up to the delay length
+            const int numTaps = config.engine.size;
+            for (int t = 0; t < numTaps; ++t)
+                processor.setTap (t, config.delaySeconds * static_cast<float> (t + 1) / static_cast<float> (numTaps),
+                                  0.5f, t % 2 == 0 ? -0.5f : 0.5f);
+            processor.setNumTaps (numTaps);
+        }
+        if (config.engine.mode == MyGreatProjectAudioProcessor::Mode::reverb) {
+            auto* lines = processor.parameters.getParameter (ParameterIDs::fdnSize);
+            lines->setValueNotifyingHost (lines->convertTo0to1 (config.engine.size == 16 ? 1.0f : 0.0f));
+        }
+        if (config.engine.mode == MyGreatProjectAudioProcessor::Mode::granular) {
+            //half-second grains an octave up, half of them reversed and shimmering: density sets how many are in flight
+            const std::pair<const char*, float> settings[] = {
+                { ParameterIDs::grainSize, 500.0f }, { ParameterIDs::grainDensity, 2.0f * static_cast<float> (config.engine.size) },
+                { ParameterIDs::grainSpray, 250.0f }, { ParameterIDs::grainPitch, 12.0f }, { ParameterIDs::grainReverse, 0.5f },
+                { ParameterIDs::shimmer, 0.5f },
+            };
+            for (const auto& [id, value] : settings) {
+                auto* parameter = processor.parameters.getParameter (id);
+                parameter->setValueNotifyingHost (parameter->convertTo0to1 (value));
+            }
+        }
+        if (config.engine.coloured) {
+            auto* tone = processor.parameters.getParameter (ParameterIDs::tone);
+            auto* drive = processor.parameters.getParameter (ParameterIDs::drive);
+            tone->setValueNotifyingHost (tone->convertTo0to1 (3500.0f));
+            drive->setValueNotifyingHost (drive->convertTo0to1 (9.0f));
+        }
+        processor.setNonRealtime (options.offline);
+        processor.prepareToPlay (config.sampleRate, config.blockSize);
+
+        //pre-generated noise, so the timing doesn't include the random number generator
+        juce::AudioBuffer<SampleType> noise (config.numChannels, config.blockSize);
+        juce::Random random (1234);
+        for (int ch = 0; ch < config.numChannels; ++ch)
+            for (int i = 0; i < config.blockSize; ++i)
+                noise.setSample (ch, i, static_cast<SampleType> (random.nextFloat() * 0.5f - 0.25f));
+
+        juce::AudioBuffer<SampleType> buffer (config.numChannels, config.blockSize);
+        juce::MidiBuffer midi;
+        if (config.engine.controllerInterval > 0) {
+            //the feedback CC (20), held at the value the case asks for, so only the splitting is measured
+            auto* feedback = processor.parameters.getParameter (ParameterIDs::feedback);
+            const int value = juce::roundToInt (feedback->convertTo0to1 (config.feedback) * 127.0f);
+            for (int i = 0; i < config.blockSize; i += config.engine.controllerInterval)
+                midi.addEvent (juce::MidiMessage::controllerEvent (1, 20, value), i);
+        }
+
+        const int numBlocks = std::max (32, static_cast<int> (options.secondsOfAudio * config.sampleRate / config.blockSize));
+        //the idle engine only goes idle once the whole line has been silent, so it warms up for that long
+        const int warmupBlocks = config.engine.silentInput ? processor.delayLine.getCapacity() / config.blockSize + 8 : 8;
+        std::vector<double> blockNanos;
+        blockNanos.reserve (static_cast<size_t> (numBlocks));
+
+        for (int block = 0; block < warmupBlocks + numBlocks; ++block) {
+            if (config.engine.silentInput)
+                buffer.clear();
+            else
+                for (int ch = 0; ch < config.numChannels; ++ch)
+                    buffer.copyFrom (ch, 0, noise, ch, 0, config.blockSize);
+
+            const auto start = std::chrono::steady_clock::now();
+            processor.processBlock (buffer, midi);
+            const auto end = std::chrono::steady_clock::now();
+
+            if (block >= warmupBlocks)
+                blockNanos.push_back (std::chrono::duration<double, std::nano> (end - start).count());
+        }
+
+        const size_t memoryBytes = processor.getMemoryUsage();
+        processor.releaseResources();
+        if (tracing) {
+            traceFile.deleteFile();
+            juce::FileOutputStream stream (traceFile);
+            if (stream.openedOk())
+                processor.profiler.writeTrace (stream);
+        }
+
+        double totalNanos = 0.0;
+        for (auto ns : blockNanos)
+            totalNanos += ns;
+
+        std::sort (blockNanos.begin(), blockNanos.end());
+        const double samplesProcessed = static_cast<double> (numBlocks) * config.blockSize;
+
+        BenchmarkResult result;
+        result.config = config;
+        result.numBlocks = numBlocks;
+        result.nsPerSample = totalNanos / (samplesProcessed * config.numChannels);
+        result.realtimeFactor = (samplesProcessed / config.sampleRate) / (totalNanos * 1.0e-9);
+        result.p50Micros = percentile (blockNanos, 0.50) * 1.0e-3;
+        result.p99Micros = percentile (blockNanos, 0.99) * 1.0e-3;
+        result.maxMicros = blockNanos.back() * 1.0e-3;
+        result.memoryBytes = memoryBytes;
+        result.chunkSize = processor.getChunkSize();
+        result.speedup = 0.0;
+        return result;
+    }
+
+    ConstructionResult measureConstruction (int numInstances) {
+        std::vector<std::unique_ptr<MyGreatProjectAudioProcessor>> instances;
+        instances.reserve (static_cast<size_t> (numInstances));
+
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < numInstances; ++i)
+            instances.push_back (std::make_unique<MyGreatProjectAudioProcessor>());
+        const auto constructed = std::chrono::steady_clock::now();
+        instances.clear();
+        const auto destroyed = std::chrono::steady_clock::now();
+
+        const auto micros = [numInstances] (auto duration) {
+            return std::chrono::duration<double, std::micro> (duration).count() / numInstances;
+        };
+        return { numInstances, micros (constructed - start), micros (destroyed - constructed) };
+    }
+
+    int runSelfTest() {
+        MyGreatProjectAudioProcessor processor;
+        processor.runTests();
+
+        juce::String results;
+        for (const bool passed : processor.tests)
+            results << (passed ? "1 " : "0 ");
+        std::cout << "Self-test: " << results << std::endl;
+        for (const auto& message : processor.messages)
+            std::cout << message << std::endl;
+
+        std::cout << (processor.output ? "All tests passed" : "Self-test FAILED") << std::endl;
+        return processor.output ? 0 : 1;
+    }
+
+    //for each wide bus and engine, the mean speedup from splitting at every block size, and the smallest block size
+    //from which it stays above paysOffSpeedup
+    void printSplitSummary (const std::vector<BenchmarkResult>& results) {
+        std::map<std::pair<int, std::string>, std::map<int, std::pair<double, int>>> speedups;
+        for (const auto& r : results)
+            if (r.speedup > 0.0) {
+                auto& sum = speedups[{ r.config.numChannels, r.config.engine.name }][r.config.blockSize];
+                sum.first += r.speedup;
+                ++sum.second;
+            }
+        if (speedups.empty())
+            return;
+
+        std::cout << std::endl << "Splitting wide buses over threads (mean speedup by block size):" << std::endl;
+        for (const auto& [bus, byBlockSize] : speedups) {
+            juce::String line = juce::String::formatted ("%3d ch %-7s", bus.first, bus.second.c_str());
+            int paysOffFrom = 0;
+            for (const auto& [blockSize, sum] : byBlockSize) {
+                const double mean = sum.first / sum.second;
+                line += juce::String::formatted ("  %5d: %.2fx", blockSize, mean);
+                if (mean < paysOffSpeedup)
+                    paysOffFrom = 0;
+                else if (paysOffFrom == 0)
+                    paysOffFrom = blockSize;
+            }
+            line += (paysOffFrom > 0 ? "  -> pays off from " + juce::String (paysOffFrom) + " samples" : juce::String ("  -> doesn't pay off"));
+            std::cout << line << std::endl;
+        }
+    }
+
+    juce::var toJson (const Options& options, const ConstructionResult& construction,
+                      const std::vector<BenchmarkResult>& results) {
+        juce::Array<juce::var> cases;
+        for (const auto& r : results) {
+            auto* obj = new juce::DynamicObject();
+            obj->setProperty ("sampleRate", r.config.sampleRate);
+            obj->setProperty ("blockSize", r.config.blockSize);
+            obj->setProperty ("channels", r.config.numChannels);
+            obj->setProperty ("delaySeconds", r.config.delaySeconds);
+            obj->setProperty ("feedback", r.config.feedback);
+            obj->setProperty ("engine", r.config.engine.name);
+            obj->setProperty ("precision", r.config.doublePrecision ? "double" : "float");
+            obj->setProperty ("blocks", r.numBlocks);
+            obj->setProperty ("nsPerSample", r.nsPerSample);
+            obj->setProperty ("realtimeFactor", r.realtimeFactor);
+            obj->setProperty ("p50Micros", r.p50Micros);
+            obj->setProperty ("p99Micros", r.p99Micros);
+            obj->setProperty ("maxMicros", r.maxMicros);
+            obj->setProperty ("memoryBytes", static_cast<juce::int64> (r.memoryBytes));
+            obj->setProperty ("chunkSize", r.chunkSize);
+            if (r.speedup > 0.0)
+                obj->setProperty ("splitSpeedup", r.speedup);
+            cases.add (juce::var (obj));
+        }
+
+        auto* constructionObj = new juce::DynamicObject();
+        constructionObj->setProperty ("instances", construction.numInstances);
+        constructionObj->setProperty ("constructMicros", construction.constructMicros);
+        constructionObj->setProperty ("destroyMicros", construction.destroyMicros);
+
+        auto* root = new juce::DynamicObject();
+        root->setProperty ("benchmark", "MyGreatProjectAudioProcessor");
+        root->setProperty ("cpu", juce::SystemStats::getCpuModel());
+        root->setProperty ("os", juce::SystemStats::getOperatingSystemName());
+        root->setProperty ("format", getFormatName (options.format));
+        root->setProperty ("instructionSet", getInstructionSetName (getActiveInstructionSet()));
+        root->setProperty ("offline", options.offline);
+        root->setProperty ("construction", juce::var (constructionObj));
+        root->setProperty ("cases", cases);
+        return juce::var (root);
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser; //the processor's parameter state needs a message manager
+    const auto options = parseOptions (argc, argv);
+    limitInstructionSet (options.instructionSet);
+    if (options.selfTest)
+        return runSelfTest();
+
+    const auto construction = measureConstruction (options.numInstances);
+    std::cout << juce::String::formatted ("Construction: %d instances, %.2f us to create, %.2f us to destroy (mean)",
+                                          construction.numInstances, construction.constructMicros,
+                                          construction.destroyMicros)
+              << std::endl;
+    std::cout << "Kernels: " << getInstructionSetName (getActiveInstructionSet())
+              << " (the CPU supports " << getInstructionSetName (getSupportedInstructionSet()) << ")" << std::endl;
+    //held for the whole run, so the render threads aren't started again for every case
+    const auto renderPool = RenderThreadPool::getInstance();
+    renderPool->start();
+    if (options.offline)
+        std::cout << "Rendering offline: " << renderPool->getNumWorkers() << " render threads" << std::endl;
+    std::cout << std::endl;
+
+    const auto grid = makeGrid (options);
+    if (grid.empty()) {
+        std::cerr << "No case matches --engine; the engines are:";
+        for (const auto& engine : engines)
+            std::cerr << " " << engine.name;
+        std::cerr << std::endl;
+        return 1;
+    }
+    const auto traceFile = options.tracePath.isNotEmpty() ? juce::File::getCurrentWorkingDirectory().getChildFile (options.tracePath)
+                                                          : juce::File();
+
+    std::cout << "   rate  block  ch  delay(s)   fb  engine  prec    ns/sample   x realtime   p50(us)   p99(us)   max(us)   memory(KB)   split" << std::endl;
+
+    //wide realtime cases are run serially as well, to see what the worker threads bring
+    const bool compareSplit = ! options.offline && std::thread::hardware_concurrency() > 1;
+    std::vector<BenchmarkResult> results;
+    for (const auto& config : grid) {
+        auto r = config.doublePrecision ? runCase<double> (config, options, traceFile)
+                                        : runCase<float> (config, options, traceFile);
+        if (compareSplit && config.numChannels >= wideBusChannels) {
+            const auto serial = config.doublePrecision ? runCase<double> (config, options, juce::File(), false)
+                                                       : runCase<float> (config, options, juce::File(), false);
+            r.speedup = serial.nsPerSample / r.nsPerSample;
+        }
+        results.push_back (r);
+        std::cout << juce::String::formatted ("%7.0f %6d %3d %9.3f %5.2f %-7s %-6s %11.3f %12.1f %9.2f %9.2f %9.2f %12.1f",
+                                              config.sampleRate, config.blockSize, config.numChannels,
+                                              config.delaySeconds, config.feedback, config.engine.name,
+                                              config.doublePrecision ? "double" : "float", r.nsPerSample,
+                                              r.realtimeFactor, r.p50Micros, r.p99Micros, r.maxMicros,
+                                              static_cast<double> (r.memoryBytes) / 1024.0)
+                  << (r.speedup > 0.0 ? juce::String::formatted ("   %5.2fx", r.speedup) : juce::String ("       -"))
+                  << std::endl;
+    }
+    printSplitSummary (results);
+
+    const auto json = juce::JSON::toString (toJson (options, construction, results));
+    if (options.jsonPath.isNotEmpty()) {
+        if (! juce::File::getCurrentWorkingDirectory().getChildFile (options.jsonPath).replaceWithText (json)) {
+            std::cerr << "Couldn't write " << options.jsonPath << std::endl;
+            return 1;
+        }
+        std::cout << "Wrote " << options.jsonPath << std::endl;
+    }
+    if (traceFile != juce::File())
+        std::cout << "Wrote " << options.tracePath << " (the last case)" << std::endl;
+
+    return 0;
+}
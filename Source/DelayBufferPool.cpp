@@ -0,0 +1,196 @@
+/*
+  ==============================================================================
+
+    DelayBufferPool.cpp
+
+  ==============================================================================
+*/
+
+#include "DelayBufferPool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <new>
+
+#if defined (_WIN32)
+ #ifndef NOMINMAX
+  #define NOMINMAX
+ #endif
+ #include <windows.h>
+#else
+ #include <sys/mman.h>
+ #include <unistd.h>
+#endif
+
+#define POOL_PAGE_SIZE 4096
+#define POOL_HUGE_PAGE_SIZE (size_t { 2 } << 20)
+
+//==============================================================================
+void DelayBufferPool::Block::reset() noexcept {
+    if (memory != nullptr)
+        pool->release (memory, bytes);
+    pool.reset();
+    memory = nullptr;
+    bytes = 0;
+}
+
+void DelayBufferPool::Block::swap (Block& other) noexcept {
+    std::swap (pool, other.pool);
+    std::swap (memory, other.memory);
+    std::swap (bytes, other.bytes);
+}
+
+//==============================================================================
+DelayBufferPool::~DelayBufferPool() {
+    //every block holds a reference, so only idle blocks can be left by now
+    for (auto& idle : idleBlocks)
+        freeToSystem (idle.second, idle.first);
+}
+
+std::shared_ptr<DelayBufferPool> DelayBufferPool::getInstance() {
+    static std::mutex instanceLock;
+    static std::weak_ptr<DelayBufferPool> instance;
+
+    std::lock_guard<std::mutex> guard (instanceLock);
+    auto pool = instance.lock();
+    if (pool == nullptr) {
+        pool.reset (new DelayBufferPool());
+        pool->self = pool;
+        instance = pool;
+    }
+    return pool;
+}
+
+DelayBufferPool::Block DelayBufferPool::acquire (size_t numBytes) {
+    Block block;
+    if (numBytes == 0)
+        return block;
+
+    const size_t bytes = roundUpSize (numBytes);
+    {
+        //best fit, but don't hand out a block more than twice the size asked for
+        std::lock_guard<std::mutex> guard (lock);
+        auto idle = idleBlocks.lower_bound (bytes);
+        if (idle != idleBlocks.end() && idle->first / 2 <= bytes) {
+            block.bytes = idle->first;
+            block.memory = idle->second;
+            idleBlocks.erase (idle);
+            stats.bytesIdle -= block.bytes;
+            --stats.blocksIdle;
+        }
+    }
+
+    const bool fromSystem = (block.memory == nullptr);
+    if (fromSystem) {
+        block.memory = allocateFromSystem (bytes);
+        block.bytes = bytes;
+
+        //fault every page in now rather than on the audio thread's first pass over the line
+        auto* pages = static_cast<volatile unsigned char*> (block.memory);
+        for (size_t offset = 0; offset < bytes; offset += POOL_PAGE_SIZE)
+            pages[offset] = 0;
+    }
+
+    block.pool = self.lock();
+    std::lock_guard<std::mutex> guard (lock);
+    stats.bytesInUse += block.bytes;
+    ++stats.blocksInUse;
+    if (fromSystem)
+        ++stats.systemAllocations;
+    return block;
+}
+
+DelayBufferPool::Stats DelayBufferPool::getStats() const {
+    std::lock_guard<std::mutex> guard (lock);
+    return stats;
+}
+
+void DelayBufferPool::releaseIdleBlocks() {
+    std::multimap<size_t, void*> toFree;
+    {
+        std::lock_guard<std::mutex> guard (lock);
+        toFree.swap (idleBlocks);
+        stats.bytesIdle = 0;
+        stats.blocksIdle = 0;
+    }
+    for (auto& idle : toFree)
+        freeToSystem (idle.second, idle.first);
+}
+
+void DelayBufferPool::release (void* memory, size_t bytes) noexcept {
+    std::lock_guard<std::mutex> guard (lock);
+    stats.bytesInUse -= bytes;
+    --stats.blocksInUse;
+    try {
+        idleBlocks.emplace (bytes, memory);
+        stats.bytesIdle += bytes;
+        ++stats.blocksIdle;
+    } catch (...) {
+        freeToSystem (memory, bytes);
+        return;
+    }
+    trimIdleBlocks();
+}
+
+void DelayBufferPool::trimIdleBlocks() noexcept {
+    //keep enough idle memory for the instances in use to swap blocks around, largest blocks go first
+    const size_t allowance = std::max (maxIdleBytes, stats.bytesInUse);
+    while (stats.bytesIdle > allowance) {
+        auto largest = std::prev (idleBlocks.end());
+        freeToSystem (largest->second, largest->first);
+        stats.bytesIdle -= largest->first;
+        --stats.blocksIdle;
+        idleBlocks.erase (largest);
+    }
+}
+
+//==============================================================================
+size_t DelayBufferPool::roundUpSize (size_t numBytes) noexcept {
+    const size_t granularity = numBytes >= POOL_HUGE_PAGE_SIZE ? POOL_HUGE_PAGE_SIZE : POOL_PAGE_SIZE;
+    return (numBytes + granularity - 1) / granularity * granularity;
+}
+
+void* DelayBufferPool::allocateFromSystem (size_t bytes) {
+   #if defined (_WIN32)
+    //large pages need a privilege most users don't have, so these are normal pages
+    void* memory = VirtualAlloc (nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (memory == nullptr)
+        throw std::bad_alloc();
+    return memory;
+   #else
+    if (bytes < POOL_HUGE_PAGE_SIZE) {
+        void* memory = mmap (nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
+            throw std::bad_alloc();
+        return memory;
+    }
+
+    //map one huge page more than needed and unmap the ends, so the block starts on a huge page boundary
+    const size_t mapped = bytes + POOL_HUGE_PAGE_SIZE;
+    auto* start = static_cast<char*> (mmap (nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (start == MAP_FAILED)
+        throw std::bad_alloc();
+
+    const auto address = reinterpret_cast<uintptr_t> (start);
+    auto* aligned = start + ((POOL_HUGE_PAGE_SIZE - address % POOL_HUGE_PAGE_SIZE) % POOL_HUGE_PAGE_SIZE);
+    if (aligned > start)
+        munmap (start, static_cast<size_t> (aligned - start));
+    if (aligned + bytes < start + mapped)
+        munmap (aligned + bytes, static_cast<size_t> (start + mapped - (aligned + bytes)));
+
+   #ifdef MADV_HUGEPAGE
+    madvise (aligned, bytes, MADV_HUGEPAGE);
+   #endif
+    return aligned;
+   #endif
+}
+
+void DelayBufferPool::freeToSystem (void* memory, size_t bytes) noexcept {
+   #if defined (_WIN32)
+    (void) bytes;
+    VirtualFree (memory, 0, MEM_RELEASE);
+   #else
+    munmap (memory, bytes);
+   #endif
+}
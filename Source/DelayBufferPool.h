@@ -0,0 +1,113 @@
+/*
+  ==============================================================================
+
+    DelayBufferPool.h
+    Process-wide pool of the large blocks that delay lines keep their samples in.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+
+//==============================================================================
+/**
+    Every plugin instance in the process takes its delay memory from one shared
+    pool. The pool is reference counted: getInstance() creates it for the first
+    user, and it is destroyed (and its memory unmapped) when the last instance
+    and the last block let go of it.
+
+    Blocks come straight from the OS (mmap/VirtualAlloc), so they are page
+    aligned, which is a whole number of cache lines. Blocks of a couple of
+    megabytes or more are aligned to 2 MB and marked for transparent huge pages
+    where the OS supports it. Fresh memory is touched page by page in acquire(),
+    so the page faults happen on the thread that prepares the instance and not
+    on the audio thread.
+
+    A block that is let go returns to the pool instead of the OS. The next
+    acquire() of a similar size takes it back, so a host re-preparing hundreds of
+    instances after a sample rate change mostly trades blocks between them
+    instead of allocating. Idle blocks beyond maxIdleBytes, and beyond what is
+    in use, are returned to the OS.
+
+    acquire() and block release take a lock and may call the OS, so neither
+    should happen on the audio thread.
+*/
+class DelayBufferPool
+{
+public:
+    /** A block of memory owned by the pool. Movable only; the memory goes back
+        to the pool when the Block is destroyed or reset.
+    */
+    class Block
+    {
+    public:
+        Block() = default;
+        ~Block()                                    { reset(); }
+        Block (Block&& other) noexcept              { swap (other); }
+        Block& operator= (Block&& other) noexcept   { Block (std::move (other)).swap (*this); return *this; }
+
+        void* data() const noexcept                 { return memory; }
+        size_t size() const noexcept                { return bytes; }
+
+        /** Gives the memory back to the pool. */
+        void reset() noexcept;
+
+    private:
+        friend class DelayBufferPool;
+        void swap (Block& other) noexcept;
+
+        std::shared_ptr<DelayBufferPool> pool;
+        void* memory = nullptr;
+        size_t bytes = 0;
+
+        Block (const Block&) = delete;
+        Block& operator= (const Block&) = delete;
+    };
+
+    struct Stats
+    {
+        size_t bytesInUse = 0, bytesIdle = 0;
+        int blocksInUse = 0, blocksIdle = 0;
+        int systemAllocations = 0;  //blocks ever taken from the OS; stays flat while blocks are being recycled
+    };
+
+    ~DelayBufferPool();
+
+    /** The pool shared by everything in this process. */
+    static std::shared_ptr<DelayBufferPool> getInstance();
+
+    /** Returns a block of at least numBytes. The contents are unspecified:
+        recycled blocks keep whatever their last user left in them.
+    */
+    Block acquire (size_t numBytes);
+
+    Stats getStats() const;
+
+    /** Returns every idle block to the OS. */
+    void releaseIdleBlocks();
+
+    static constexpr size_t maxIdleBytes = size_t { 64 } << 20;
+
+private:
+    DelayBufferPool() = default;
+
+    void release (void* memory, size_t bytes) noexcept;
+    void trimIdleBlocks() noexcept;
+
+    static size_t roundUpSize (size_t numBytes) noexcept;
+    static void* allocateFromSystem (size_t bytes);
+    static void freeToSystem (void* memory, size_t bytes) noexcept;
+
+    std::weak_ptr<DelayBufferPool> self;
+    mutable std::mutex lock;
+    std::multimap<size_t, void*> idleBlocks; //by size, for best fit
+    Stats stats;
+
+    DelayBufferPool (const DelayBufferPool&) = delete;
+    DelayBufferPool& operator= (const DelayBufferPool&) = delete;
+};
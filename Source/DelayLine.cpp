@@ -0,0 +1,490 @@
+/*
+  ==============================================================================
+
+    DelayLine.cpp
+
+  ==============================================================================
+*/
+
+#include "DelayLine.h"
+
+int DelayLine::capacityFor (int maxDelaySamples) noexcept {
+    //one spare slot so the longest delay never reads the sample being written
+    int newCapacity = 2;
+    while (newCapacity <= maxDelaySamples)
+        newCapacity <<= 1;
+    return newCapacity;
+}
+
+void DelayLine::setSize (int newNumChannels, int maxDelaySamples, SampleFormat newFormat) {
+    const int newCapacity = capacityFor (maxDelaySamples);
+    newNumChannels = std::max (0, newNumChannels);
+    if (newNumChannels == numChannels && newCapacity == capacity && newFormat == format) {
+        selectKernels(); //the layout stands, but the instruction set may have been limited since
+        return;
+    }
+
+    numChannels = newNumChannels;
+    capacity = newCapacity;
+    mask = capacity - 1;
+    format = newFormat;
+    selectKernels();
+    //a smaller layout reuses the block it has; a bigger one trades it for a bigger one from the pool
+    if (storage.size() < bytesInUse()) {
+        storage.reset();
+        storage = DelayBufferPool::getInstance()->acquire (bytesInUse());
+    }
+    clear();
+}
+
+void DelayLine::setSizeAndResample (int newNumChannels, int maxDelaySamples, double rateRatio, SampleFormat newFormat) {
+    if (rateRatio <= 0.0 || capacity == 0) {
+        setSize (newNumChannels, maxDelaySamples, newFormat);
+        clear();
+        return;
+    }
+
+    //unpack the old contents, oldest layout first, then lay the storage out again. the unpacked copy is float, so for
+    //16-bit storage it's twice the line: it only lives for this call
+    const int oldChannels = numChannels, oldCapacity = capacity, oldMask = mask, oldWritePos = writePos;
+    std::vector<float> oldContents (static_cast<size_t> (oldChannels) * static_cast<size_t> (oldCapacity));
+    withCodec ([&] (auto codec) {
+        using Codec = decltype (codec);
+        const auto* stored = channelData<Codec> (0);
+        for (size_t i = 0; i < oldContents.size(); ++i)
+            oldContents[i] = Codec::decode (stored[i]);
+    });
+
+    numChannels = 0; //force setSize to lay the storage out again
+    setSize (newNumChannels, maxDelaySamples, newFormat);
+
+    //walk backwards from the write head: the sample `age` steps old now sits `age / rateRatio` steps back in the old line
+    const int channelsToKeep = std::min (oldChannels, numChannels);
+    const int maxAge = std::min (capacity - 1, static_cast<int> ((oldCapacity - 2) * rateRatio));
+    withCodec ([&] (auto codec) {
+        using Codec = decltype (codec);
+        for (int ch = 0; ch < channelsToKeep; ++ch) {
+            const float* oldLine = oldContents.data() + static_cast<size_t> (ch) * static_cast<size_t> (oldCapacity);
+            auto* line = channelData<Codec> (ch);
+            for (int age = 1; age <= maxAge; ++age) {
+                const double oldAge = std::max (1.0, age / rateRatio);
+                const int a = static_cast<int> (oldAge);
+                const float frac = static_cast<float> (oldAge - a);
+                const float newer = oldLine[(oldWritePos - a) & oldMask];
+                const float older = oldLine[(oldWritePos - a - 1) & oldMask];
+                line[(writePos - age) & mask] = Codec::encode (newer + frac * (older - newer));
+            }
+        }
+    });
+}
+
+void DelayLine::clear() {
+    //zero is all-bits-zero in every format
+    if (storage.data() != nullptr)
+        std::memset (storage.data(), 0, bytesInUse());
+    writePos = 0;
+    writeCount = 0;
+}
+
+void DelayLine::copyHistoryFrom (const DelayLine& source, int64_t sourceWriteCount, int maxAge) {
+    const int channels = std::min (numChannels, source.numChannels);
+    maxAge = std::min ({ maxAge, capacity - 1, source.capacity - 1 });
+    writeCount = sourceWriteCount;
+    writePos = static_cast<int> (writeCount & mask);
+
+    withCodec ([&] (auto codec) {
+        using Codec = decltype (codec);
+        source.withCodec ([&] (auto sourceCodec) {
+            using SourceCodec = decltype (sourceCodec);
+            for (int ch = 0; ch < channels; ++ch) {
+                const auto* from = source.channelData<SourceCodec> (ch);
+                auto* to = channelData<Codec> (ch);
+                for (int age = 1; age <= maxAge; ++age)
+                    to[(writePos - age) & mask] = Codec::encode (SourceCodec::decode (from[(sourceWriteCount - age) & source.mask]));
+            }
+        });
+    });
+}
+
+void DelayLine::catchUpFrom (const DelayLine& source, int64_t fromWriteCount) noexcept {
+    const int channels = std::min (numChannels, source.numChannels);
+    const int64_t count = source.writeCount - fromWriteCount;
+
+    withCodec ([&] (auto codec) {
+        using Codec = decltype (codec);
+        source.withCodec ([&] (auto sourceCodec) {
+            using SourceCodec = decltype (sourceCodec);
+            for (int ch = 0; ch < channels; ++ch) {
+                const auto* from = source.channelData<SourceCodec> (ch);
+                auto* to = channelData<Codec> (ch);
+                for (int64_t c = fromWriteCount; c < source.writeCount; ++c)
+                    to[c & mask] = Codec::encode (SourceCodec::decode (from[c & source.mask]));
+            }
+        });
+    });
+
+    writeCount = fromWriteCount + std::max<int64_t> (0, count);
+    writePos = static_cast<int> (writeCount & mask);
+}
+
+void DelayLine::readHistory (float* const* history, int channelsToRead, int64_t atWriteCount, int length) const {
+    channelsToRead = std::min (channelsToRead, numChannels);
+    length = std::min (length, capacity - 1);
+    withCodec ([&] (auto codec) {
+        using Codec = decltype (codec);
+        for (int ch = 0; ch < channelsToRead; ++ch) {
+            const auto* from = channelData<Codec> (ch);
+            for (int i = 0; i < length; ++i)
+                history[ch][i] = Codec::decode (from[(atWriteCount - length + i) & mask]);
+        }
+    });
+}
+
+void DelayLine::writeHistory (const float* const* history, int channelsToWrite, int length) {
+    clear();
+    if (capacity == 0 || length <= 0)
+        return;
+
+    channelsToWrite = std::min (channelsToWrite, numChannels);
+    const int skipped = std::max (0, length - (capacity - 1)); //too old to fit
+    withCodec ([&] (auto codec) {
+        using Codec = decltype (codec);
+        for (int ch = 0; ch < channelsToWrite; ++ch) {
+            auto* to = channelData<Codec> (ch);
+            for (int i = skipped; i < length; ++i)
+                to[(i - skipped) & mask] = Codec::encode (history[ch][i]);
+        }
+    });
+    advance (length - skipped);
+}
+
+void DelayLine::readSamples (int channel, int64_t firstSample, int numSamples, float* dest) const noexcept {
+    //at most two contiguous runs: up to the end of the storage, then on from its start
+    withCodec ([&] (auto codec) {
+        using Codec = decltype (codec);
+        const auto* from = channelData<Codec> (channel);
+        for (int done = 0; done < numSamples;) {
+            const int index = static_cast<int> ((firstSample + done) & mask);
+            const int length = std::min (numSamples - done, capacity - index);
+            for (int i = 0; i < length; ++i)
+                dest[done + i] = Codec::decode (from[index + i]);
+            done += length;
+        }
+    });
+}
+
+float DelayLine::getPeak (int64_t firstSample, int numSamples) const noexcept {
+    float peak = 0.0f;
+    withCodec ([&] (auto codec) {
+        using Codec = decltype (codec);
+        for (int ch = 0; ch < numChannels; ++ch) {
+            const auto* from = channelData<Codec> (ch);
+            for (int done = 0; done < numSamples;) {
+                const int index = static_cast<int> ((firstSample + done) & mask);
+                const int length = std::min (numSamples - done, capacity - index);
+                for (int i = 0; i < length; ++i)
+                    peak = std::max (peak, std::abs (Codec::decode (from[index + i])));
+                done += length;
+            }
+        }
+    });
+    return peak;
+}
+
+void DelayLine::write (const float* const* block, int numChannelsToWrite, int numSamples) noexcept {
+    numChannelsToWrite = std::min (numChannelsToWrite, numChannels);
+    withCodec ([&] (auto codec) {
+        using Codec = decltype (codec);
+        for (int ch = 0; ch < numChannelsToWrite; ++ch) {
+            auto* to = channelData<Codec> (ch);
+            for (int done = 0; done < numSamples;) {
+                const int index = (writePos + done) & mask;
+                const int length = std::min (numSamples - done, capacity - index);
+                for (int i = 0; i < length; ++i)
+                    to[index + i] = Codec::encode (block[ch][done + i]);
+                done += length;
+            }
+        }
+    });
+    advance (numSamples);
+}
+
+void DelayLine::release() {
+    storage.reset();
+    numChannels = 0;
+    capacity = 0;
+    mask = 0;
+    writePos = 0;
+    writeCount = 0;
+}
+
+size_t DelayLine::getMemoryUsage() const noexcept {
+    return storage.size();
+}
+
+template <typename SampleType>
+void DelayLine::process (const SampleType* const* blockIn, SampleType* const* blockOut, int numChannelsToProcess,
+                         int blockLength, int delaySamples, float inputGain) noexcept {
+    const int channels = std::min (numChannelsToProcess, numChannels);
+    if (channels == 0)
+        return;
+
+    const int delay = clampDelay (delaySamples);
+    withCodec ([&] (auto codec) {
+        using Codec = decltype (codec);
+        //out[i] is read before dst[i] is written, so a short delay runs forward over the whole segment
+        forEachSegment (blockLength, &delay, 1, [&] (int writeIndex, int offset, int length) {
+            for (int ch = 0; ch < channels; ++ch) {
+                auto* line = channelData<Codec> (ch);
+                const auto* src = line + readIndex (writeIndex, delay);
+                auto* dst = line + writeIndex;
+                const SampleType* in = blockIn[ch] + offset;
+                SampleType* out = blockOut[ch] + offset;
+                for (int i = 0; i < length; ++i) {
+                    out[i] = static_cast<SampleType> (Codec::decode (src[i]));
+                    dst[i] = Codec::encode (static_cast<float> (in[i]) * inputGain);
+                }
+            }
+        }, true);
+    });
+}
+
+//==============================================================================
+//the kernels, one instantiation per instruction set, storage codec, channel count (0: given at run time) and
+//send/no send. Target::run compiles each body for its instruction set. with HasSend the line is fed from the float
+//lineInput, otherwise from the block itself, read before the echo is added. they work on the line's channels from
+//firstChannel on and leave the head alone; delays arrive already clamped. every loop runs forward, so a delay shorter
+//than the segment reads back the input this segment wrote that many samples earlier (see forEachSegment): such a loop can't vectorize past the delay, but it is one pass over the whole segment
+//rather than one kernel call per delay-long piece
+template <typename Target, typename Codec, int NumChannels, bool HasSend>
+struct DelayLine::Kernels
+{
+    template <typename SampleType>
+    static auto sendFor (const SampleType* io, const float* const* lineInput, int ch, int offset) noexcept {
+        if constexpr (HasSend)
+            return lineInput[ch] + offset;
+        else
+            return io;
+    }
+
+    template <typename SampleType>
+    static void inPlace (DelayLine& dl, SampleType* const* block, int firstChannel, int numChannels, int startSample,
+                         int numSamples, int delay, float inputGain, float inputGainStep, const float* const* lineInput) noexcept {
+        Target::run ([&] {
+            const int channels = NumChannels > 0 ? NumChannels : numChannels;
+            dl.forEachSegmentFromHead (numSamples, &delay, 1, [&] (int writeIndex, int offset, int length) {
+                const float gainStart = inputGain + inputGainStep * static_cast<float> (offset);
+                for (int ch = 0; ch < channels; ++ch) {
+                    auto* line = dl.channelData<Codec> (firstChannel + ch);
+                    const auto* src = line + dl.readIndex (writeIndex, delay);
+                    auto* dst = line + writeIndex;
+                    SampleType* io = block[ch] + startSample + offset;
+                    const auto* send = sendFor (io, lineInput, ch, offset);
+                    for (int i = 0; i < length; ++i) {
+                        dst[i] = Codec::encode (static_cast<float> (send[i]) * (gainStart + inputGainStep * static_cast<float> (i)));
+                        io[i] += static_cast<SampleType> (Codec::decode (src[i]));
+                    }
+                }
+            }, true);
+        });
+    }
+
+    template <typename SampleType>
+    static void crossfading (DelayLine& dl, SampleType* const* block, int firstChannel, int numChannels, int startSample,
+                             int numSamples, const int* delays, float fade, float fadeStep, float inputGain, float inputGainStep,
+                             const float* const* lineInput) noexcept {
+        Target::run ([&] {
+            const int channels = NumChannels > 0 ? NumChannels : numChannels;
+            dl.forEachSegmentFromHead (numSamples, delays, 2, [&] (int writeIndex, int offset, int length) {
+                const float gainStart = inputGain + inputGainStep * static_cast<float> (offset);
+                const float fadeStart = fade + fadeStep * static_cast<float> (offset);
+                for (int ch = 0; ch < channels; ++ch) {
+                    auto* line = dl.channelData<Codec> (firstChannel + ch);
+                    const auto* srcFrom = line + dl.readIndex (writeIndex, delays[0]);
+                    const auto* srcTo = line + dl.readIndex (writeIndex, delays[1]);
+                    auto* dst = line + writeIndex;
+                    SampleType* io = block[ch] + startSample + offset;
+                    const auto* send = sendFor (io, lineInput, ch, offset);
+                    for (int i = 0; i < length; ++i) {
+                        const float w = fadeStart + fadeStep * static_cast<float> (i);
+                        const float from = Codec::decode (srcFrom[i]);
+                        dst[i] = Codec::encode (static_cast<float> (send[i]) * (gainStart + inputGainStep * static_cast<float> (i)));
+                        io[i] += static_cast<SampleType> (from + w * (Codec::decode (srcTo[i]) - from));
+                    }
+                }
+            }, true);
+        });
+    }
+
+    template <typename SampleType>
+    static void taps (DelayLine& dl, SampleType* const* block, int firstChannel, int numChannels, int startSample,
+                      int numSamples, const Tap* tapList, const int* delays, int numTaps, float inputGain, float inputGainStep,
+                      const float* const* lineInput) noexcept {
+        Target::run ([&] {
+            const int channels = NumChannels > 0 ? NumChannels : numChannels;
+            dl.forEachSegmentFromHead (numSamples, delays, numTaps, [&] (int writeIndex, int offset, int length) {
+                const float gainStart = inputGain + inputGainStep * static_cast<float> (offset);
+                for (int ch = 0; ch < channels; ++ch) {
+                    auto* line = dl.channelData<Codec> (firstChannel + ch);
+                    auto* dst = line + writeIndex;
+                    SampleType* io = block[ch] + startSample + offset;
+                    const auto* send = sendFor (io, lineInput, ch, offset);
+                    //no read span runs ahead into the write span, so the input can go in before the taps are summed:
+                    //a tap shorter than the segment reads this segment's own input, as it would sample by sample
+                    for (int i = 0; i < length; ++i)
+                        dst[i] = Codec::encode (static_cast<float> (send[i]) * (gainStart + inputGainStep * static_cast<float> (i)));
+
+                    for (int t = 0; t < numTaps; ++t) {
+                        const auto* src = line + dl.readIndex (writeIndex, delays[t]);
+                        const float g = tapList[t].gains[(firstChannel + ch) & 1];
+                        for (int i = 0; i < length; ++i)
+                            io[i] += static_cast<SampleType> (g * Codec::decode (src[i]));
+                    }
+                }
+            }, true);
+        });
+    }
+};
+
+template <typename Target, typename Codec, int NumChannels>
+DelayLine::Dispatch DelayLine::makeDispatch() noexcept {
+    using NoSend = Kernels<Target, Codec, NumChannels, false>;
+    using Send = Kernels<Target, Codec, NumChannels, true>;
+    //the taps always take the channel count at run time: their time is in the per-tap loops, and unrolling the
+    //channel loop around those only made them bigger (and measurably slower in stereo)
+    using TapsNoSend = Kernels<Target, Codec, 0, false>;
+    using TapsSend = Kernels<Target, Codec, 0, true>;
+    Dispatch dispatch;
+    dispatch.floats.inPlace[0] = &NoSend::template inPlace<float>;
+    dispatch.floats.inPlace[1] = &Send::template inPlace<float>;
+    dispatch.floats.crossfading[0] = &NoSend::template crossfading<float>;
+    dispatch.floats.crossfading[1] = &Send::template crossfading<float>;
+    dispatch.floats.taps[0] = &TapsNoSend::template taps<float>;
+    dispatch.floats.taps[1] = &TapsSend::template taps<float>;
+    dispatch.doubles.inPlace[0] = &NoSend::template inPlace<double>;
+    dispatch.doubles.inPlace[1] = &Send::template inPlace<double>;
+    dispatch.doubles.crossfading[0] = &NoSend::template crossfading<double>;
+    dispatch.doubles.crossfading[1] = &Send::template crossfading<double>;
+    dispatch.doubles.taps[0] = &TapsNoSend::template taps<double>;
+    dispatch.doubles.taps[1] = &TapsSend::template taps<double>;
+    return dispatch;
+}
+
+void DelayLine::selectKernels() noexcept {
+    withInstructionSet (getActiveInstructionSet(), [this] (auto target) {
+        using Target = decltype (target);
+        withCodec ([this] (auto codec) {
+            using Codec = decltype (codec);
+            anyWidth = makeDispatch<Target, Codec, 0>();
+            //the usual bus widths (mono, stereo, quad, 7.1, 16-channel ambisonics) get their own unrolled copies
+            switch (numChannels) {
+                case 1:  fixedWidth = makeDispatch<Target, Codec, 1>();  break;
+                case 2:  fixedWidth = makeDispatch<Target, Codec, 2>();  break;
+                case 4:  fixedWidth = makeDispatch<Target, Codec, 4>();  break;
+                case 8:  fixedWidth = makeDispatch<Target, Codec, 8>();  break;
+                case 16: fixedWidth = makeDispatch<Target, Codec, 16>(); break;
+                default: fixedWidth = anyWidth;                          break;
+            }
+        });
+    });
+}
+
+template <typename SampleType>
+void DelayLine::processInPlace (SampleType* const* block, int numChannelsToProcess, int startSample, int numSamples,
+                                int delaySamples, float inputGain, float inputGainStep,
+                                const float* const* lineInput) noexcept {
+    const ChannelRange range (*this, 0, numChannelsToProcess);
+    if (range.getNumChannels() == 0)
+        return;
+
+    range.processInPlace (block, startSample, numSamples, delaySamples, inputGain, inputGainStep, lineInput);
+    advance (numSamples);
+}
+
+template <typename SampleType>
+void DelayLine::processInPlaceCrossfading (SampleType* const* block, int numChannelsToProcess, int startSample, int numSamples,
+                                           int fromDelay, int toDelay, float fade, float fadeStep,
+                                           float inputGain, float inputGainStep, const float* const* lineInput) noexcept {
+    const ChannelRange range (*this, 0, numChannelsToProcess);
+    if (range.getNumChannels() == 0)
+        return;
+
+    range.processInPlaceCrossfading (block, startSample, numSamples, fromDelay, toDelay, fade, fadeStep,
+                                     inputGain, inputGainStep, lineInput);
+    advance (numSamples);
+}
+
+template <typename SampleType>
+void DelayLine::processTapsInPlace (SampleType* const* block, int numChannelsToProcess, int startSample, int numSamples,
+                                    const Tap* taps, int numTaps, float inputGain, float inputGainStep,
+                                    const float* const* lineInput) noexcept {
+    const ChannelRange range (*this, 0, numChannelsToProcess);
+    if (range.getNumChannels() == 0)
+        return;
+
+    range.processTapsInPlace (block, startSample, numSamples, taps, numTaps, inputGain, inputGainStep, lineInput);
+    advance (numSamples);
+}
+
+//==============================================================================
+DelayLine::ChannelRange::ChannelRange (DelayLine& l, int first, int count) noexcept
+    : line (l),
+      firstChannel (std::clamp (first, 0, l.numChannels)),
+      numChannels (std::clamp (count, 0, l.numChannels - firstChannel)) {
+}
+
+template <typename SampleType>
+void DelayLine::ChannelRange::processInPlace (SampleType* const* block, int startSample, int numSamples, int delaySamples,
+                                              float inputGain, float inputGainStep,
+                                              const float* const* lineInput) const noexcept {
+    if (numChannels == 0)
+        return;
+
+    line.getKernels<SampleType> (numChannels).inPlace[lineInput != nullptr] (line, block, firstChannel, numChannels, startSample, numSamples,
+                                                                             line.clampDelay (delaySamples), inputGain, inputGainStep, lineInput);
+}
+
+template <typename SampleType>
+void DelayLine::ChannelRange::processInPlaceCrossfading (SampleType* const* block, int startSample, int numSamples,
+                                                         int fromDelay, int toDelay, float fade, float fadeStep,
+                                                         float inputGain, float inputGainStep,
+                                                         const float* const* lineInput) const noexcept {
+    if (numChannels == 0)
+        return;
+
+    const int delays[] = { line.clampDelay (fromDelay), line.clampDelay (toDelay) };
+    line.getKernels<SampleType> (numChannels).crossfading[lineInput != nullptr] (line, block, firstChannel, numChannels, startSample, numSamples,
+                                                                                 delays, fade, fadeStep, inputGain, inputGainStep, lineInput);
+}
+
+template <typename SampleType>
+void DelayLine::ChannelRange::processTapsInPlace (SampleType* const* block, int startSample, int numSamples,
+                                                  const Tap* taps, int numTaps, float inputGain, float inputGainStep,
+                                                  const float* const* lineInput) const noexcept {
+    numTaps = std::clamp (numTaps, 0, maxTaps);
+    if (numChannels == 0)
+        return;
+
+    int delays[maxTaps];
+    for (int t = 0; t < numTaps; ++t)
+        delays[t] = line.clampDelay (taps[t].delaySamples);
+
+    line.getKernels<SampleType> (numChannels).taps[lineInput != nullptr] (line, block, firstChannel, numChannels, startSample, numSamples,
+                                                                          taps, delays, numTaps, inputGain, inputGainStep, lineInput);
+}
+
+//the host's block is float or double (see AudioProcessor::supportsDoublePrecisionProcessing)
+template void DelayLine::process<float> (const float* const*, float* const*, int, int, int, float) noexcept;
+template void DelayLine::process<double> (const double* const*, double* const*, int, int, int, float) noexcept;
+template void DelayLine::processInPlace<float> (float* const*, int, int, int, int, float, float, const float* const*) noexcept;
+template void DelayLine::processInPlace<double> (double* const*, int, int, int, int, float, float, const float* const*) noexcept;
+template void DelayLine::processInPlaceCrossfading<float> (float* const*, int, int, int, int, int, float, float, float, float, const float* const*) noexcept;
+template void DelayLine::processInPlaceCrossfading<double> (double* const*, int, int, int, int, int, float, float, float, float, const float* const*) noexcept;
+template void DelayLine::processTapsInPlace<float> (float* const*, int, int, int, const Tap*, int, float, float, const float* const*) noexcept;
+template void DelayLine::processTapsInPlace<double> (double* const*, int, int, int, const Tap*, int, float, float, const float* const*) noexcept;
+template void DelayLine::ChannelRange::processInPlace<float> (float* const*, int, int, int, float, float, const float* const*) const noexcept;
+template void DelayLine::ChannelRange::processInPlace<double> (double* const*, int, int, int, float, float, const float* const*) const noexcept;
+template void DelayLine::ChannelRange::processInPlaceCrossfading<float> (float* const*, int, int, int, int, float, float, float, float, const float* const*) const noexcept;
+template void DelayLine::ChannelRange::processInPlaceCrossfading<double> (double* const*, int, int, int, int, float, float, float, float, const float* const*) const noexcept;
+template void DelayLine::ChannelRange::processTapsInPlace<float> (float* const*, int, int, const Tap*, int, float, float, const float* const*) const noexcept;
+template void DelayLine::ChannelRange::processTapsInPlace<double> (double* const*, int, int, const Tap*, int, float, float, const float* const*) const noexcept;
@@ -0,0 +1,369 @@
+/*
+  ==============================================================================
+
+    DelayLine.h
+    Fixed-capacity circular buffers used as the delay lines for every channel.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "DelayBufferPool.h"
+#include "InstructionSet.h"
+#include "SampleFormat.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+//==============================================================================
+/**
+    A multichannel ring buffer delay line. Every channel lives in the same
+    allocation, one after the other (structure of arrays), and they all share
+    one write head, so a bus of any width is a single object.
+
+    The capacity is always rounded up to a power of two so the heads wrap with a
+    single mask, which keeps the cost per sample constant no matter how long the
+    delay is. Blocks are walked in contiguous segments that never wrap and never
+    let the read span overlap the write span, so the inner loops are plain array
+    loops the compiler can vectorise.
+
+    The samples live in one block from the process-wide DelayBufferPool, so
+    lines of every instance share and recycle the same memory.
+
+    Samples can be stored as 32-bit floats or in one of the 16-bit formats from
+    SampleFormat.h. Every kernel is a template on the codec, so packing and
+    unpacking happen inside the same vectorised loops, and on the channel count
+    (1, 2, 4, 8 or 16; any other width gets a run-time count) and on whether a
+    separate send is written into the line. setSize() picks the instantiations
+    for the layout once and keeps them as function pointers, so a call costs one
+    indirect jump and its loops have nothing left to decide.
+
+    The kernels are also templates on the host's sample type, instantiated for
+    float and double: a 64-bit host's block is read and mixed in double without
+    a conversion copy, and only what goes into the line is narrowed to the
+    storage format.
+
+    Every instantiation is built once more per instruction set in
+    InstructionSet.h (AVX2 and AVX-512 on x86), and setSize() takes the copies
+    for getActiveInstructionSet(), so one binary runs the widest loops the CPU
+    has without being built for it.
+*/
+class DelayLine
+{
+public:
+    DelayLine() = default;
+
+    /** The most read points processTapsInPlace() accepts. */
+    static constexpr int maxTaps = 32;
+
+    /** One read point of a multi-tap delay. gains[0] applies to even (left)
+        channels and gains[1] to odd (right) ones, which is how a tap is panned
+        on a stereo bus; set both to the same value for any other width.
+    */
+    struct Tap
+    {
+        int delaySamples = 1;
+        float gains[2] = { 0.0f, 0.0f };
+    };
+
+    /** Makes room for numChannels lines with delays of up to maxDelaySamples,
+        stored in the given format.
+
+        Storage is only reallocated when it has to grow; hosts re-prepare often, so
+        the block is kept (never shrunk) until release(). If the layout is unchanged
+        the contents are kept too, otherwise the line is cleared.
+    */
+    void setSize (int numChannels, int maxDelaySamples, SampleFormat format = SampleFormat::float32);
+
+    /** Changes the layout like setSize(), but keeps the audio: every channel's
+        history is resampled by rateRatio (new rate / old rate) with linear
+        interpolation, so echoes already in the line survive a sample rate change.
+    */
+    void setSizeAndResample (int numChannels, int maxDelaySamples, double rateRatio,
+                             SampleFormat format = SampleFormat::float32);
+
+    /** Zeroes the contents and rewinds the write head. */
+    void clear();
+
+    /** Hands the storage back to the pool and leaves the line empty until the next setSize(). */
+    void release();
+
+    int getNumChannels() const noexcept     { return numChannels; }
+
+    /** The number of samples each channel can hold (always a power of two). */
+    int getCapacity() const noexcept        { return capacity; }
+
+    SampleFormat getFormat() const noexcept { return format; }
+
+    /** How many samples have been written since the line was last cleared. */
+    int64_t getWriteCount() const noexcept  { return writeCount; }
+
+    /** For growing a line off the audio thread: fills this (already sized) line
+        with the history source had when its write count was sourceWriteCount,
+        for ages 1 to maxAge, and continues counting from there.
+
+        Only reads source samples older than sourceWriteCount, so it can run while
+        the audio thread keeps writing to source, as long as that thread writes
+        fewer than getCapacity() - maxAge samples in the meantime.
+    */
+    void copyHistoryFrom (const DelayLine& source, int64_t sourceWriteCount, int maxAge);
+
+    /** Copies whatever source wrote since fromWriteCount, so a line filled with
+        copyHistoryFrom() is up to date and can replace source. Cheap: it only
+        moves the samples of the last few blocks.
+    */
+    void catchUpFrom (const DelayLine& source, int64_t fromWriteCount) noexcept;
+
+    /** Decodes the newest length samples of the first numChannels channels into
+        history, oldest first, as they were when the write count was atWriteCount.
+        Like copyHistoryFrom(), it only reads samples older than atWriteCount, so
+        another thread can take a copy while the audio thread keeps writing.
+    */
+    void readHistory (float* const* history, int numChannels, int64_t atWriteCount, int length) const;
+
+    /** Clears the line and writes history (length samples per channel, oldest
+        first) as if it had just been played in, so it comes back out at the same
+        delays. Only the newest getCapacity() - 1 samples fit.
+    */
+    void writeHistory (const float* const* history, int numChannels, int length);
+
+    /** Bytes currently held for samples, including spare capacity kept from earlier layouts. */
+    size_t getMemoryUsage() const noexcept;
+
+    /** Reads blockLength samples that were written delaySamples ago into blockOut,
+        and writes blockIn scaled by inputGain at the write head, for the first
+        numChannelsToProcess channels.
+
+        delaySamples is clamped to [1, getCapacity() - 1].
+    */
+    template <typename SampleType>
+    void process (const SampleType* const* blockIn, SampleType* const* blockOut, int numChannelsToProcess,
+                  int blockLength, int delaySamples, float inputGain) noexcept;
+
+    /** The fused version of process(): adds the delayed signal into each channel
+        in place while writing the original block scaled by the input gain into the
+        line. Only samples [startSample, startSample + numSamples) are touched.
+
+        The gain moves linearly, inputGain + inputGainStep * i, so a smoothed
+        parameter can be applied without a per-sample branch.
+
+        If lineInput is given, its channels (numSamples each, starting at index 0)
+        are written into the line instead of the block, e.g. after a colour stage,
+        while the echo is still added to the dry block. It is always float, since
+        the line never holds more precision than that.
+    */
+    template <typename SampleType>
+    void processInPlace (SampleType* const* block, int numChannelsToProcess, int startSample, int numSamples,
+                         int delaySamples, float inputGain, float inputGainStep = 0.0f,
+                         const float* const* lineInput = nullptr) noexcept;
+
+    /** Like processInPlace(), but reads from two delay times and crossfades linearly
+        from fromDelay to toDelay (weight fade + fadeStep * i on toDelay), so the
+        delay time can change without a click.
+    */
+    template <typename SampleType>
+    void processInPlaceCrossfading (SampleType* const* block, int numChannelsToProcess, int startSample, int numSamples,
+                                    int fromDelay, int toDelay, float fade, float fadeStep,
+                                    float inputGain, float inputGainStep, const float* const* lineInput = nullptr) noexcept;
+
+    /** Like processInPlace(), but adds up to maxTaps read points from the same
+        line. Each segment writes the input first, then accumulates one tap at a
+        time as a contiguous multiply-add, so extra taps cost one streaming pass
+        each rather than a per-sample gather.
+    */
+    template <typename SampleType>
+    void processTapsInPlace (SampleType* const* block, int numChannelsToProcess, int startSample, int numSamples,
+                             const Tap* taps, int numTaps, float inputGain, float inputGainStep,
+                             const float* const* lineInput = nullptr) noexcept;
+
+    //==============================================================================
+    /** Some of the line's channels, for splitting one block's channels across
+        threads. The calls work like the line's own, but only on the line's
+        channels [firstChannel, firstChannel + numChannels), with block[0] (and
+        lineInput[0]) being firstChannel, and they leave the write head where it
+        is. Ranges that don't overlap can process the same block at the same
+        time; once all of them are done, advance() moves the head past it.
+    */
+    class ChannelRange
+    {
+    public:
+        ChannelRange (DelayLine& line, int firstChannel, int numChannels) noexcept;
+
+        template <typename SampleType>
+        void processInPlace (SampleType* const* block, int startSample, int numSamples, int delaySamples,
+                             float inputGain, float inputGainStep = 0.0f,
+                             const float* const* lineInput = nullptr) const noexcept;
+
+        template <typename SampleType>
+        void processInPlaceCrossfading (SampleType* const* block, int startSample, int numSamples,
+                                        int fromDelay, int toDelay, float fade, float fadeStep,
+                                        float inputGain, float inputGainStep,
+                                        const float* const* lineInput = nullptr) const noexcept;
+
+        template <typename SampleType>
+        void processTapsInPlace (SampleType* const* block, int startSample, int numSamples,
+                                 const Tap* taps, int numTaps, float inputGain, float inputGainStep,
+                                 const float* const* lineInput = nullptr) const noexcept;
+
+        int getFirstChannel() const noexcept    { return firstChannel; }
+        int getNumChannels() const noexcept     { return numChannels; }
+
+    private:
+        DelayLine& line;
+        int firstChannel, numChannels;
+    };
+
+    ChannelRange getChannelRange (int firstChannel, int numChannels) noexcept { return { *this, firstChannel, numChannels }; }
+
+    /** Moves the write head numSamples on, e.g. once ChannelRanges have processed a block. */
+    void advance (int numSamples) noexcept {
+        writePos = (writePos + numSamples) & mask;
+        writeCount += numSamples;
+    }
+
+    //==============================================================================
+    // Building blocks for engines that treat each channel as an independent line
+    // with its own delay (see FeedbackDelayNetwork). getChannel() is only valid
+    // for float32 lines.
+
+    float* getChannel (int channel) noexcept {
+        assert (format == SampleFormat::float32);
+        return static_cast<float*> (storage.data()) + static_cast<size_t> (channel) * static_cast<size_t> (capacity);
+    }
+
+    int clampDelay (int delaySamples) const noexcept { return std::clamp (delaySamples, 1, capacity - 1); }
+    int readIndex (int writeIndex, int delay) const noexcept { return (writeIndex - delay) & mask; }
+
+    /** Decodes numSamples of one channel into dest, oldest first, starting with the
+        sample written when the write count was firstSample. Every sample must still
+        be in the line: no older than getWriteCount() - getCapacity() and older than
+        getWriteCount(). Works in any storage format (see GranularDelay).
+    */
+    void readSamples (int channel, int64_t firstSample, int numSamples, float* dest) const noexcept;
+
+    /** The largest magnitude among numSamples of every channel, starting with the
+        sample written when the write count was firstSample (with the same limits as
+        readSamples()). Decodes in place, so nothing is copied (see TelemetryFrame).
+    */
+    float getPeak (int64_t firstSample, int numSamples) const noexcept;
+
+    /** Encodes numSamples of the first numChannelsToWrite channels of block at the
+        write head, then moves the head past them.
+    */
+    void write (const float* const* block, int numChannelsToWrite, int numSamples) noexcept;
+
+    /** Calls fn (writeIndex, offset, length) for each stretch of the block in
+        which no head wraps and no read span overlaps the write span. The delays
+        must already be clamped with clampDelay().
+
+        With inOrder, fn promises to walk each stretch forward, reading a sample
+        only after it has written every earlier one. A delay shorter than the
+        stretch then reads back what the stretch itself wrote, which is the echo
+        it should hear, so such delays no longer cut the block into delay-long
+        pieces; only a read span ahead of the head still splits it.
+    */
+    template <typename SegmentFunction>
+    void forEachSegment (int blockLength, const int* delays, int numDelays, SegmentFunction&& fn,
+                         bool inOrder = false) noexcept {
+        forEachSegmentFromHead (blockLength, delays, numDelays, fn, inOrder);
+        advance (blockLength);
+    }
+
+private:
+    /** forEachSegment() without moving the head, so several threads can walk the same block. */
+    template <typename SegmentFunction>
+    void forEachSegmentFromHead (int blockLength, const int* delays, int numDelays, SegmentFunction&& fn,
+                                 bool inOrder = false) const noexcept {
+        int maxLength = capacity;
+        for (int d = 0; d < numDelays; ++d)
+            maxLength = std::min ({ maxLength, inOrder ? capacity : delays[d], capacity - delays[d] });
+
+        int position = writePos;
+        for (int offset = 0; offset < blockLength;) {
+            int length = std::min ({ blockLength - offset, maxLength, capacity - position });
+            for (int d = 0; d < numDelays; ++d)
+                length = std::min (length, capacity - readIndex (position, delays[d]));
+
+            fn (position, offset, length);
+            offset += length;
+            position = (position + length) & mask;
+        }
+    }
+
+    template <typename Target, typename Codec, int NumChannels, bool HasSend>
+    struct Kernels;
+
+    template <typename SampleType>
+    struct KernelSet
+    {
+        using InPlace = void (*) (DelayLine&, SampleType* const*, int, int, int, int, int, float, float, const float* const*) noexcept;
+        using Crossfading = void (*) (DelayLine&, SampleType* const*, int, int, int, int, const int*, float, float, float, float, const float* const*) noexcept;
+        using Taps = void (*) (DelayLine&, SampleType* const*, int, int, int, int, const Tap*, const int*, int, float, float, const float* const*) noexcept;
+
+        InPlace inPlace[2] {}; //each indexed by whether there's a separate send
+        Crossfading crossfading[2] {};
+        Taps taps[2] {};
+    };
+
+    struct Dispatch
+    {
+        KernelSet<float> floats;
+        KernelSet<double> doubles;
+    };
+
+    template <typename Target, typename Codec, int NumChannels>
+    static Dispatch makeDispatch() noexcept;
+
+    /** Fills fixedWidth and anyWidth for the current format, channel count and instruction set. */
+    void selectKernels() noexcept;
+
+    template <typename SampleType>
+    const KernelSet<SampleType>& getKernels (int channelsToProcess) const noexcept {
+        const Dispatch& dispatch = channelsToProcess == numChannels ? fixedWidth : anyWidth;
+        if constexpr (std::is_same_v<SampleType, double>)
+            return dispatch.doubles;
+        else
+            return dispatch.floats;
+    }
+
+    static int capacityFor (int maxDelaySamples) noexcept;
+
+    template <typename Codec>
+    typename Codec::Stored* channelData (int channel) noexcept {
+        return static_cast<typename Codec::Stored*> (storage.data()) + static_cast<size_t> (channel) * static_cast<size_t> (capacity);
+    }
+
+    template <typename Codec>
+    const typename Codec::Stored* channelData (int channel) const noexcept {
+        return const_cast<DelayLine*> (this)->channelData<Codec> (channel);
+    }
+
+    /** Calls fn with a default-constructed codec for the current format. */
+    template <typename Function>
+    void withCodec (Function&& fn) const {
+        switch (format) {
+            case SampleFormat::int16:    fn (Int16Codec {});    break;
+            case SampleFormat::bfloat16: fn (BFloat16Codec {}); break;
+            case SampleFormat::float32:
+            default:                     fn (Float32Codec {});  break;
+        }
+    }
+
+    size_t bytesInUse() const noexcept {
+        return static_cast<size_t> (numChannels) * static_cast<size_t> (capacity) * static_cast<size_t> (getBytesPerSample (format));
+    }
+
+    DelayBufferPool::Block storage; //every channel, in whatever format; may be bigger than bytesInUse()
+    SampleFormat format = SampleFormat::float32;
+    int numChannels = 0;
+    int capacity = 0;
+    int mask = 0;
+    int writePos = 0;       //always writeCount & mask
+    int64_t writeCount = 0;
+    Dispatch fixedWidth;    //kernels for exactly numChannels channels
+    Dispatch anyWidth;      //the same with a run-time channel count, for calls that process fewer
+};
@@ -0,0 +1,241 @@
+/*
+  ==============================================================================
+
+    DelayLineResizer.cpp
+
+  ==============================================================================
+*/
+
+#include "DelayLineResizer.h"
+
+#include <algorithm>
+#include <chrono>
+
+#define RESIZER_POLL_MS 20
+
+//==============================================================================
+/** The one thread that serves every started resizer in the process. */
+class DelayLineResizer::Worker
+{
+public:
+    ~Worker() {
+        {
+            std::lock_guard<std::mutex> guard (lock);
+            stopping = true;
+        }
+        wake.notify_one();
+        if (thread.joinable())
+            thread.join();
+    }
+
+    static std::shared_ptr<Worker> getInstance() {
+        static std::mutex instanceLock;
+        static std::weak_ptr<Worker> instance;
+
+        std::lock_guard<std::mutex> guard (instanceLock);
+        auto worker = instance.lock();
+        if (worker == nullptr) {
+            worker.reset (new Worker());
+            instance = worker;
+        }
+        return worker;
+    }
+
+    void add (DelayLineResizer& resizer) {
+        std::lock_guard<std::mutex> guard (lock);
+        resizers.push_back (&resizer);
+        if (! thread.joinable())
+            thread = std::thread ([this] { run(); });
+    }
+
+    /** Returns once the thread isn't serving resizer any more, and won't again. */
+    void remove (DelayLineResizer& resizer) {
+        std::lock_guard<std::mutex> guard (lock);
+        resizers.erase (std::remove (resizers.begin(), resizers.end(), &resizer), resizers.end());
+    }
+
+    void notify() {
+        wake.notify_one();
+    }
+
+private:
+    Worker() = default;
+
+    void run() {
+        //the audio thread can't wake us (that takes a lock), so its requests are picked up by polling. one pass over
+        //the resizers is a couple of atomic loads each, and resizers are served under the lock so remove() can wait
+        std::unique_lock<std::mutex> guard (lock);
+        while (! stopping) {
+            wake.wait_for (guard, std::chrono::milliseconds (RESIZER_POLL_MS));
+            for (auto* resizer : resizers)
+                resizer->serve();
+        }
+    }
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::vector<DelayLineResizer*> resizers; //guarded by lock
+    bool stopping = false;
+    std::thread thread;
+};
+
+//==============================================================================
+DelayLineResizer::DelayLineResizer() : worker (Worker::getInstance()) {
+}
+
+DelayLineResizer::~DelayLineResizer() {
+    if (started)
+        worker->remove (*this);
+}
+
+void DelayLineResizer::start() {
+    if (! started)
+        worker->add (*this);
+    started = true;
+}
+
+void DelayLineResizer::reset() {
+    std::lock_guard<std::mutex> lock (buildLock);
+    state.store (idle);
+    grown = DelayLine();
+    restoreTarget = nullptr;
+    restoreSamples = {};
+}
+
+void DelayLineResizer::request (const DelayLine& line, int maxDelaySamples) noexcept {
+    int expected = idle;
+    if (state.load (std::memory_order_relaxed) != idle)
+        return;
+
+    //plain members are published by the release in the exchange below
+    source = &line;
+    requestedMaxDelay = maxDelaySamples;
+    requestedChannels = -1;
+    state.compare_exchange_strong (expected, requested, std::memory_order_release);
+}
+
+void DelayLineResizer::requestLayout (const DelayLine& line, int numChannels, int maxDelaySamples) noexcept {
+    int expected = idle;
+    if (state.load (std::memory_order_relaxed) != idle)
+        return;
+
+    source = &line;
+    requestedMaxDelay = maxDelaySamples;
+    requestedChannels = std::max (0, numChannels);
+    state.compare_exchange_strong (expected, requested, std::memory_order_release);
+}
+
+void DelayLineResizer::blockFinished (const DelayLine& line) noexcept {
+    publishedWriteCount.store (line.getWriteCount(), std::memory_order_release);
+}
+
+bool DelayLineResizer::swapIfReady (DelayLine& line) noexcept {
+    if (state.load (std::memory_order_acquire) != ready)
+        return false;
+
+    //another thread is copying the line in readHistory(): swap at a later block instead of waiting for it
+    int expected = 0;
+    if (! lineReaders.compare_exchange_strong (expected, -1, std::memory_order_acquire))
+        return false;
+
+    if (! replacing) {
+        //if the audio thread wrote past the margin while the copy ran, the oldest copied
+        //samples may have been overwritten under it: build again from a fresh snapshot
+        if (line.getWriteCount() - snapshotWriteCount >= copyMargin) {
+            lineReaders.store (0, std::memory_order_release);
+            state.store (requested, std::memory_order_release);
+            return false;
+        }
+        grown.catchUpFrom (line, snapshotWriteCount);
+    }
+
+    std::swap (line, grown);
+    lineReaders.store (0, std::memory_order_release);
+    state.store (retired, std::memory_order_release);
+    return true;
+}
+
+bool DelayLineResizer::isBusy() const noexcept {
+    const int s = state.load (std::memory_order_relaxed);
+    return s == requested || s == building || s == ready;
+}
+
+int DelayLineResizer::readHistory (const DelayLine& line, float* const* history, int numChannels, int length) {
+    //hold off swaps: the audio thread only swaps while nobody reads, and we only start reading once it isn't swapping
+    for (;;) {
+        int readers = lineReaders.load (std::memory_order_relaxed);
+        if (readers >= 0 && lineReaders.compare_exchange_weak (readers, readers + 1, std::memory_order_acquire))
+            break;
+        std::this_thread::yield();
+    }
+
+    //like a grow, leave the oldest quarter alone, which the audio thread may overwrite while we read. the write count
+    //is published at the end of each block, so half of that margin is left for the block in progress
+    const int64_t writeCount = publishedWriteCount.load (std::memory_order_acquire);
+    const int margin = std::max (1, line.getCapacity() / 4);
+    int read = static_cast<int> (std::min<int64_t> ({ length, writeCount, line.getCapacity() - 1 - margin }));
+    if (read > 0) {
+        line.readHistory (history, numChannels, writeCount, read);
+        if (publishedWriteCount.load (std::memory_order_acquire) - writeCount >= margin / 2)
+            read = 0;
+    }
+    lineReaders.fetch_sub (1, std::memory_order_release);
+    return std::max (0, read);
+}
+
+void DelayLineResizer::restoreHistory (const DelayLine& line, std::vector<float> samples, int numChannels, int length) {
+    {
+        std::lock_guard<std::mutex> lock (buildLock);
+        restoreTarget = &line;
+        restoreSamples = std::move (samples);
+        restoreChannels = numChannels;
+        restoreLength = length;
+    }
+    worker->notify();
+}
+
+void DelayLineResizer::serve() {
+    std::lock_guard<std::mutex> lock (buildLock);
+    int expected = retired;
+    if (state.compare_exchange_strong (expected, idle, std::memory_order_acquire)) {
+        grown = DelayLine(); //the old, smaller storage is freed here rather than on the audio thread
+        return;
+    }
+
+    expected = requested;
+    if (state.compare_exchange_strong (expected, building, std::memory_order_acquire)) {
+        //copy everything but the oldest quarter of the live line, which is the part
+        //the audio thread could overwrite while we copy
+        const DelayLine& live = *source;
+        if (requestedChannels >= 0) {
+            //a new layout: nothing to copy, and the line it replaces is freed once it's retired
+            if (requestedChannels > 0)
+                grown.setSize (requestedChannels, requestedMaxDelay, live.getFormat());
+            replacing = true;
+            state.store (ready, std::memory_order_release);
+            return;
+        }
+        copyMargin = std::max (1, live.getCapacity() / 4);
+        snapshotWriteCount = publishedWriteCount.load (std::memory_order_acquire);
+        grown.setSize (live.getNumChannels(), requestedMaxDelay, live.getFormat());
+        grown.copyHistoryFrom (live, snapshotWriteCount, live.getCapacity() - 1 - copyMargin);
+        replacing = false;
+        state.store (ready, std::memory_order_release);
+        return;
+    }
+
+    //a restored history waits for any grow in flight, and then replaces the line at its current size
+    expected = idle;
+    if (restoreTarget != nullptr && state.compare_exchange_strong (expected, building, std::memory_order_acquire)) {
+        const DelayLine& live = *restoreTarget;
+        std::vector<const float*> history;
+        for (int ch = 0; ch < restoreChannels; ++ch)
+            history.push_back (restoreSamples.data() + static_cast<size_t> (ch) * static_cast<size_t> (restoreLength));
+        grown.setSize (live.getNumChannels(), live.getCapacity() - 1, live.getFormat());
+        grown.writeHistory (history.data(), restoreChannels, restoreLength);
+        restoreTarget = nullptr;
+        restoreSamples = {};
+        replacing = true;
+        state.store (ready, std::memory_order_release);
+    }
+}
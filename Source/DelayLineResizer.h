@@ -0,0 +1,124 @@
+/*
+  ==============================================================================
+
+    DelayLineResizer.h
+    Grows a DelayLine on a background thread and hands it to the audio thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "DelayLine.h"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//==============================================================================
+/**
+    Lets the audio thread ask for a longer delay line without allocating.
+
+    The audio thread calls request() when it needs more room, and blockFinished()
+    after every block so the background thread knows which part of the live line
+    is settled. The background thread allocates a bigger line, copies the settled
+    history into it and marks it ready; at the start of a later block
+    swapIfReady() copies the few samples written since, then swaps the two lines,
+    which only exchanges pointers. The old storage is freed back on the
+    background thread.
+
+    The same handoff restores a saved history: restoreHistory() has the
+    background thread build a line holding it, which the audio thread swaps in
+    as it is. readHistory() goes the other way, copying the live line from any
+    other thread while the audio thread keeps playing it.
+
+    The background thread is one worker shared by every resizer in the process,
+    reference counted like DelayBufferPool: it wakes every few milliseconds (or
+    when a message thread call has work for it) and serves whichever resizers
+    have something to do, so a session of hundreds of instances still has a
+    single, mostly idle thread. It is only started by the first start() (from
+    prepareToPlay), so constructing a processor doesn't spawn anything.
+*/
+class DelayLineResizer
+{
+public:
+    DelayLineResizer();
+    ~DelayLineResizer();
+
+    /** Message thread: has the shared background thread serve this resizer, starting it if need be. */
+    void start();
+
+    /** Message thread: drops any request or half-built line, e.g. before prepareToPlay resizes the live line. */
+    void reset();
+
+    /** Audio thread: asks for a copy of line that can hold delays of maxDelaySamples.
+        Does nothing if a request is already in flight.
+    */
+    void request (const DelayLine& line, int maxDelaySamples) noexcept;
+
+    /** Audio thread: asks for an empty line of numChannels x maxDelaySamples to replace
+        line, whatever it holds, e.g. to allocate a line only while it's used. With 0
+        channels the line is replaced by an empty one, and its storage freed on the
+        background thread. Does nothing if a request is already in flight.
+    */
+    void requestLayout (const DelayLine& line, int numChannels, int maxDelaySamples) noexcept;
+
+    /** Audio thread: publishes how much of line has been written, at the end of every block. */
+    void blockFinished (const DelayLine& line) noexcept;
+
+    /** Audio thread: if a grown line is ready, brings it up to date and swaps it
+        into line. Returns true if the line was replaced.
+    */
+    bool swapIfReady (DelayLine& line) noexcept;
+
+    /** True while a request is waiting or being built. */
+    bool isBusy() const noexcept;
+
+    /** Any thread but the audio thread: reads the newest length samples of line into
+        history (see DelayLine::readHistory) while the audio thread keeps playing it;
+        grown lines wait to be swapped in until it's done. Returns how many samples per
+        channel it read: fewer than asked for if the line holds less, and 0 if the audio
+        thread wrote too much while the copy ran.
+    */
+    int readHistory (const DelayLine& line, float* const* history, int numChannels, int length);
+
+    /** Message thread: replaces what line holds with samples, length per channel for
+        numChannels channels, oldest first (see DelayLine::writeHistory). The background
+        thread builds the line once no grow is in flight, and the audio thread swaps it
+        in at the start of a block. reset() drops it.
+    */
+    void restoreHistory (const DelayLine& line, std::vector<float> samples, int numChannels, int length);
+
+private:
+    enum State { idle, requested, building, ready, retired };
+
+    class Worker;
+
+    /** Background thread: does whatever the state asks for (builds a line, or frees a retired one). */
+    void serve();
+
+    std::shared_ptr<Worker> worker;
+    bool started = false; //message thread only
+
+    std::atomic<int> state { idle };
+    std::atomic<int64_t> publishedWriteCount { 0 };
+    const DelayLine* source = nullptr;
+    int requestedMaxDelay = 0;
+    int requestedChannels = -1; //set by requestLayout(); -1 grows the source as it is
+    int64_t snapshotWriteCount = 0;
+    int copyMargin = 0;
+    DelayLine grown;
+    bool replacing = false; //grown is a restored history, to be swapped in without catching up
+    std::mutex buildLock; //between the background and message threads only
+    std::atomic<int> lineReaders { 0 }; //threads in readHistory(), or -1 while swapIfReady() replaces the line
+
+    //a history waiting for restoreHistory() to build it, guarded by buildLock
+    const DelayLine* restoreTarget = nullptr;
+    std::vector<float> restoreSamples;
+    int restoreChannels = 0, restoreLength = 0;
+
+    JUCE_DECLARE_NON_COPYABLE (DelayLineResizer)
+};
@@ -0,0 +1,111 @@
+/*
+  ==============================================================================
+
+    DspLoadProfiler.cpp
+
+  ==============================================================================
+*/
+
+#include "DspLoadProfiler.h"
+
+#include <chrono>
+#include <vector>
+
+int64_t DspLoadProfiler::now() noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void DspLoadProfiler::recordBlock (const char* name, int64_t startNanos, int64_t endNanos, int numSamples, double sampleRate) noexcept {
+    //single writer: plain load + store is enough, the atomics are there for the readers
+    if (resetRequested.exchange (false, std::memory_order_acquire)) {
+        for (auto& bin : histogram)
+            bin.store (0, std::memory_order_relaxed);
+        blocks.store (0, std::memory_order_relaxed);
+        overruns.store (0, std::memory_order_relaxed);
+        maxLoad.store (0.0f, std::memory_order_relaxed);
+    }
+
+    if (numSamples <= 0 || sampleRate <= 0.0)
+        return;
+
+    const double budgetNanos = numSamples * 1.0e9 / sampleRate;
+    const float load = static_cast<float> (static_cast<double> (endNanos - startNanos) / budgetNanos);
+    auto& bin = histogram[static_cast<size_t> (std::min (numBins, static_cast<int> (load * 100.0f)))];
+    bin.store (bin.load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    blocks.store (blocks.load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (load > 1.0f)
+        overruns.store (overruns.load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (load > maxLoad.load (std::memory_order_relaxed))
+        maxLoad.store (load, std::memory_order_relaxed);
+
+    if (isTracing())
+        recordSpan (name, startNanos, endNanos, numSamples);
+}
+
+void DspLoadProfiler::recordSpan (const char* name, int64_t startNanos, int64_t endNanos, int numSamples) noexcept {
+    const int64_t index = spansWritten.load (std::memory_order_relaxed);
+    auto& span = spans[static_cast<size_t> (index % traceCapacity)];
+    span.name.store (name, std::memory_order_relaxed);
+    span.start.store (startNanos, std::memory_order_relaxed);
+    span.duration.store (endNanos - startNanos, std::memory_order_relaxed);
+    span.numSamples.store (numSamples, std::memory_order_relaxed);
+    spansWritten.store (index + 1, std::memory_order_release);
+}
+
+DspLoadProfiler::Summary DspLoadProfiler::getSummary() const noexcept {
+    Summary summary;
+    std::array<uint32_t, numBins + 1> counts;
+    int64_t total = 0;
+    for (size_t i = 0; i < counts.size(); ++i)
+        total += counts[i] = histogram[i].load (std::memory_order_relaxed);
+
+    summary.blocks = blocks.load (std::memory_order_relaxed);
+    summary.overruns = overruns.load (std::memory_order_relaxed);
+    summary.max = maxLoad.load (std::memory_order_relaxed);
+    if (total == 0)
+        return summary;
+
+    //the upper edge of the bin the percentile falls in
+    const auto percentile = [&] (double p) {
+        const auto rank = static_cast<int64_t> (p * static_cast<double> (total - 1)) + 1;
+        int64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); ++i)
+            if ((seen += counts[i]) >= rank)
+                return static_cast<float> (i + 1) / 100.0f;
+        return static_cast<float> (numBins + 1) / 100.0f;
+    };
+    summary.p50 = percentile (0.50);
+    summary.p99 = percentile (0.99);
+    return summary;
+}
+
+void DspLoadProfiler::writeTrace (juce::OutputStream& out) const {
+    //copy the spans that are still in the ring, then drop any the audio thread overwrote while we copied
+    const int64_t end = spansWritten.load (std::memory_order_acquire);
+    const int64_t begin = std::max<int64_t> (0, end - traceCapacity);
+    struct Copied { const char* name; int64_t start, duration; int numSamples; };
+    std::vector<Copied> copied;
+    copied.reserve (static_cast<size_t> (end - begin));
+    for (int64_t i = begin; i < end; ++i) {
+        const auto& span = spans[static_cast<size_t> (i % traceCapacity)];
+        copied.push_back ({ span.name.load (std::memory_order_relaxed), span.start.load (std::memory_order_relaxed),
+                            span.duration.load (std::memory_order_relaxed), span.numSamples.load (std::memory_order_relaxed) });
+    }
+    const int64_t overwritten = spansWritten.load (std::memory_order_acquire) - traceCapacity - begin;
+    const size_t firstValid = static_cast<size_t> (std::clamp<int64_t> (overwritten, 0, static_cast<int64_t> (copied.size())));
+
+    //complete ("X") events on one thread, timestamps in microseconds
+    out << "{\"traceEvents\":[";
+    bool first = true;
+    for (size_t i = firstValid; i < copied.size(); ++i) {
+        const auto& span = copied[i];
+        if (span.name == nullptr)
+            continue;
+        out << (first ? "\n" : ",\n")
+            << juce::String::formatted ("{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"samples\":%d}}",
+                                        span.name, static_cast<double> (span.start) * 1.0e-3,
+                                        static_cast<double> (span.duration) * 1.0e-3, span.numSamples);
+        first = false;
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
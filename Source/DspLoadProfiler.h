@@ -0,0 +1,143 @@
+/*
+  ==============================================================================
+
+    DspLoadProfiler.h
+    How much of the callback budget processBlock uses, measured live.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <array>
+#include <atomic>
+
+//set to 0 to compile the profiler out of processBlock entirely
+#ifndef MYGREATPROJECT_ENABLE_PROFILER
+ #define MYGREATPROJECT_ENABLE_PROFILER 1
+#endif
+
+//==============================================================================
+/**
+    Times every block against its budget (numSamples / sampleRate) and keeps a
+    histogram of the ratio in 1% bins, up to 200%, plus a count of overruns
+    (blocks that took longer than their budget: an xrun if the host has no
+    slack). Optionally, it also keeps the last traceCapacity timestamped spans,
+    which writeTrace() turns into Chrome trace event JSON for chrome://tracing
+    or ui.perfetto.dev.
+
+    The audio thread is the only writer, and everything it touches is an
+    atomic, so readers on other threads never block it. While disabled a
+    block costs one relaxed atomic load, and with MYGREATPROJECT_ENABLE_PROFILER
+    set to 0 the scoped timers are empty.
+*/
+class DspLoadProfiler
+{
+public:
+    static constexpr int numBins = 200;          //1% of the budget each; anything over lands in the last one
+    static constexpr int traceCapacity = 8192;
+
+    struct Summary
+    {
+        int64_t blocks = 0, overruns = 0;
+        float p50 = 0.0f, p99 = 0.0f, max = 0.0f; //fractions of the budget: 1.0 is the whole callback
+    };
+
+    DspLoadProfiler() = default;
+
+    void setEnabled (bool shouldBeEnabled) noexcept  { enabled.store (shouldBeEnabled, std::memory_order_relaxed); }
+    bool isEnabled() const noexcept                  { return enabled.load (std::memory_order_relaxed); }
+
+    /** Spans are only recorded while tracing (and enabled). */
+    void setTracing (bool shouldTrace) noexcept      { tracing.store (shouldTrace, std::memory_order_relaxed); }
+    bool isTracing() const noexcept                  { return tracing.load (std::memory_order_relaxed); }
+
+    /** Any thread: the audio thread clears the statistics at the start of its next block. */
+    void reset() noexcept                            { resetRequested.store (true, std::memory_order_release); }
+
+    /** Any thread. */
+    Summary getSummary() const noexcept;
+
+    /** Writes the recorded spans as Chrome trace event JSON. Not for the audio thread. */
+    void writeTrace (juce::OutputStream& out) const;
+
+    //==============================================================================
+    /** Audio thread: times the whole block it lives in. */
+    class ScopedBlock
+    {
+    public:
+       #if MYGREATPROJECT_ENABLE_PROFILER
+        ScopedBlock (DspLoadProfiler& p, int numSamples, double sampleRate) noexcept
+            : profiler (p.isEnabled() ? &p : nullptr), samples (numSamples), rate (sampleRate) {
+            if (profiler != nullptr)
+                start = now();
+        }
+
+        ~ScopedBlock() {
+            if (profiler != nullptr)
+                profiler->recordBlock ("processBlock", start, now(), samples, rate);
+        }
+
+       private:
+        DspLoadProfiler* profiler;
+        int64_t start = 0;
+        int samples;
+        double rate;
+       #else
+        ScopedBlock (DspLoadProfiler&, int, double) noexcept {}
+       #endif
+
+        JUCE_DECLARE_NON_COPYABLE (ScopedBlock)
+    };
+
+    /** Audio thread: a named span inside a block, only recorded while tracing. name must be a string literal. */
+    class ScopedSpan
+    {
+    public:
+       #if MYGREATPROJECT_ENABLE_PROFILER
+        ScopedSpan (DspLoadProfiler& p, const char* spanName, int numSamples) noexcept
+            : profiler (p.isEnabled() && p.isTracing() ? &p : nullptr), name (spanName), samples (numSamples) {
+            if (profiler != nullptr)
+                start = now();
+        }
+
+        ~ScopedSpan() {
+            if (profiler != nullptr)
+                profiler->recordSpan (name, start, now(), samples);
+        }
+
+       private:
+        DspLoadProfiler* profiler;
+        const char* name;
+        int64_t start = 0;
+        int samples;
+       #else
+        ScopedSpan (DspLoadProfiler&, const char*, int) noexcept {}
+       #endif
+
+        JUCE_DECLARE_NON_COPYABLE (ScopedSpan)
+    };
+
+private:
+    struct Span
+    {
+        std::atomic<const char*> name { nullptr };
+        std::atomic<int64_t> start { 0 }, duration { 0 };
+        std::atomic<int> numSamples { 0 };
+    };
+
+    static int64_t now() noexcept;
+    void recordBlock (const char* name, int64_t startNanos, int64_t endNanos, int numSamples, double sampleRate) noexcept;
+    void recordSpan (const char* name, int64_t startNanos, int64_t endNanos, int numSamples) noexcept;
+
+    std::atomic<bool> enabled { false }, tracing { false }, resetRequested { false };
+    std::array<std::atomic<uint32_t>, numBins + 1> histogram {};
+    std::atomic<int64_t> blocks { 0 }, overruns { 0 };
+    std::atomic<float> maxLoad { 0.0f };
+    std::array<Span, traceCapacity> spans;
+    std::atomic<int64_t> spansWritten { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE (DspLoadProfiler)
+};
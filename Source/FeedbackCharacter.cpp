@@ -0,0 +1,267 @@
+/*
+  ==============================================================================
+
+    FeedbackCharacter.cpp
+
+  ==============================================================================
+*/
+
+#include "FeedbackCharacter.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define CHARACTER_DRIVE_RAMP_SECONDS 0.02
+#define CHARACTER_FIRST_STAGE_SIDE_TAPS 16    //31-tap half-band at 2x
+#define CHARACTER_SECOND_STAGE_SIDE_TAPS 8    //15 taps at 4x, where the transition band is twice as wide
+#define CHARACTER_ADAA_THRESHOLD 1.0e-3f      //below this step the antiderivative difference is mostly rounding error
+
+namespace
+{
+    constexpr double pi = 3.14159265358979323846;
+
+    //the clipper: k * (u - u^3 / 3) with u = x / k clamped to [-1, 1], so it has unity slope at zero
+    //and reaches its ceiling of 1.0 with zero slope at |x| = k
+    constexpr float clipKnee = 1.5f;
+
+    inline float clip (float x) noexcept {
+        const float u = std::clamp (x * (1.0f / clipKnee), -1.0f, 1.0f);
+        return clipKnee * (u - u * u * u * (1.0f / 3.0f));
+    }
+
+    //its antiderivative, continued linearly past the knee
+    inline float clipAntiderivative (float x) noexcept {
+        const float v = x * (1.0f / clipKnee);
+        const float u = std::clamp (v, -1.0f, 1.0f);
+        const float u2 = u * u;
+        return clipKnee * clipKnee * (u2 * 0.5f - u2 * u2 * (1.0f / 12.0f) + (2.0f / 3.0f) * (std::abs (v) - std::abs (u)));
+    }
+}
+
+//==============================================================================
+void FeedbackCharacter::HalfbandStage::design (int numSideTaps) {
+    //windowed-sinc half-band: every other tap is zero except the centre one (0.5), so the
+    //filter splits into one branch of numSideTaps taps and one pure delay
+    length = 2 * numSideTaps - 1;
+    const int centre = (length - 1) / 2;
+    sideTaps.assign (static_cast<size_t> (numSideTaps), 0.0f);
+    double sum = 0.0;
+    for (int j = 0; j < numSideTaps; ++j) {
+        const double m = 2 * j - centre;    //always odd
+        const double sinc = std::sin (pi * m * 0.5) / (pi * m);
+        const double phase = 2.0 * pi * (2 * j + 1) / (length + 1);
+        const double blackman = 0.42 - 0.5 * std::cos (phase) + 0.08 * std::cos (2.0 * phase);
+        sideTaps[static_cast<size_t> (j)] = static_cast<float> (sinc * blackman);
+        sum += sinc * blackman;
+    }
+
+    //the side taps have to add up to 0.5 for unity gain at DC
+    for (auto& tap : sideTaps)
+        tap = static_cast<float> (tap * 0.5 / sum);
+}
+
+void FeedbackCharacter::HalfbandStage::prepare (int numChannels) {
+    const size_t channels = static_cast<size_t> (std::max (0, numChannels));
+    upHistory.assign (channels * (sideTaps.size() - 1), 0.0f);
+    downHistory.assign (channels * static_cast<size_t> (length - 1), 0.0f);
+    //big enough for the longest input either direction sees (4 * chunkSize, into the 4x stage's downsampler)
+    const size_t maxSamples = static_cast<size_t> (length - 1 + 4 * chunkSize);
+    scratch.assign (maxSamples, 0.0f);
+    evenPhase.assign (maxSamples / 2 + 1, 0.0f);
+    oddPhase.assign (maxSamples / 2 + 1, 0.0f);
+    accumulator.assign (static_cast<size_t> (2 * chunkSize), 0.0f);
+}
+
+void FeedbackCharacter::HalfbandStage::reset() noexcept {
+    std::fill (upHistory.begin(), upHistory.end(), 0.0f);
+    std::fill (downHistory.begin(), downHistory.end(), 0.0f);
+}
+
+void FeedbackCharacter::HalfbandStage::upsample (int channel, const float* in, float* out, int numSamples) noexcept {
+    //zero-stuffing halves the signal, hence the 2: even outputs come from the side taps,
+    //odd ones are the input delayed to line up with the centre tap
+    const int historyLength = static_cast<int> (sideTaps.size()) - 1;
+    float* history = upHistory.data() + static_cast<size_t> (channel * historyLength);
+    float* x = scratch.data();
+    std::copy (history, history + historyLength, x);
+    std::copy (in, in + numSamples, x + historyLength);
+
+    //one pass per tap over the whole chunk, so the inner loops are contiguous multiply-adds
+    float* sum = accumulator.data();
+    std::fill (sum, sum + numSamples, 0.0f);
+    for (int j = 0; j < static_cast<int> (sideTaps.size()); ++j) {
+        const float tap = 2.0f * sideTaps[static_cast<size_t> (j)];
+        const float* from = x + historyLength - j;
+        for (int i = 0; i < numSamples; ++i)
+            sum[i] += tap * from[i];
+    }
+
+    const float* centre = x + historyLength - (static_cast<int> (sideTaps.size()) / 2 - 1);
+    for (int i = 0; i < numSamples; ++i) {
+        out[2 * i] = sum[i];
+        out[2 * i + 1] = centre[i];
+    }
+
+    std::copy (x + numSamples, x + numSamples + historyLength, history);
+}
+
+void FeedbackCharacter::HalfbandStage::downsample (int channel, const float* in, float* out, int numSamples) noexcept {
+    const int historyLength = length - 1;
+    const int centre = historyLength / 2;
+    float* history = downHistory.data() + static_cast<size_t> (channel * historyLength);
+    float* z = scratch.data();
+    std::copy (history, history + historyLength, z);
+    std::copy (in, in + 2 * numSamples, z + historyLength);
+
+    //split into the two phases: the side taps only ever see even samples and the centre tap odd ones
+    //(historyLength is even and the centre odd), so both become contiguous streams
+    const int numPairs = historyLength / 2 + numSamples;
+    float* even = evenPhase.data();
+    float* odd = oddPhase.data();
+    for (int k = 0; k < numPairs; ++k) {
+        even[k] = z[2 * k];
+        odd[k] = z[2 * k + 1];
+    }
+
+    const float* centreTap = odd + (historyLength - centre - 1) / 2;
+    for (int i = 0; i < numSamples; ++i)
+        out[i] = 0.5f * centreTap[i];
+    for (int j = 0; j < static_cast<int> (sideTaps.size()); ++j) {
+        const float tap = sideTaps[static_cast<size_t> (j)];
+        const float* from = even + historyLength / 2 - j;
+        for (int i = 0; i < numSamples; ++i)
+            out[i] += tap * from[i];
+    }
+
+    std::copy (z + 2 * numSamples, z + 2 * numSamples + historyLength, history);
+}
+
+//==============================================================================
+void FeedbackCharacter::prepare (double newSampleRate, int numChannels) {
+    sampleRate = newSampleRate;
+    numPreparedChannels = std::max (0, numChannels);
+    firstStage.design (CHARACTER_FIRST_STAGE_SIDE_TAPS);
+    secondStage.design (CHARACTER_SECOND_STAGE_SIDE_TAPS);
+    firstStage.prepare (numPreparedChannels);
+    secondStage.prepare (numPreparedChannels);
+    toneState.assign (static_cast<size_t> (numPreparedChannels), 0.0f);
+    adaaPrevious.assign (static_cast<size_t> (numPreparedChannels), 0.0f);
+    work.assign (static_cast<size_t> (chunkSize + 1), 0.0f);
+    upsampled.assign (static_cast<size_t> (2 * chunkSize), 0.0f);
+    upsampledTwice.assign (static_cast<size_t> (4 * chunkSize), 0.0f);
+
+    const float drive = driveGain.getTargetValue();
+    driveGain.reset (sampleRate, CHARACTER_DRIVE_RAMP_SECONDS);
+    driveGain.setCurrentAndTarget (drive > 0.0f ? drive : 1.0f);
+    setTone (toneHz);
+}
+
+void FeedbackCharacter::reset() noexcept {
+    std::fill (toneState.begin(), toneState.end(), 0.0f);
+    std::fill (adaaPrevious.begin(), adaaPrevious.end(), 0.0f);
+    firstStage.reset();
+    secondStage.reset();
+}
+
+void FeedbackCharacter::setTone (float cutoffHz) noexcept {
+    toneHz = std::clamp (cutoffHz, 20.0f, maxToneHz);
+    toneCoefficient = toneHz >= maxToneHz
+                    ? 1.0f
+                    : static_cast<float> (1.0 - std::exp (-2.0 * pi * toneHz / sampleRate));
+}
+
+void FeedbackCharacter::setDrive (float decibels) noexcept {
+    driveGain.setTarget (std::pow (10.0f, std::max (0.0f, decibels) * 0.05f));
+}
+
+void FeedbackCharacter::setAntialiasing (Antialiasing mode) noexcept {
+    if (mode == antialiasing)
+        return;
+    antialiasing = mode;
+    firstStage.reset();
+    secondStage.reset();
+}
+
+bool FeedbackCharacter::isActive() const noexcept {
+    return toneCoefficient < 1.0f || driveGain.getCurrentValue() > 1.0f || driveGain.isSmoothing();
+}
+
+int FeedbackCharacter::getLatencySamples() const noexcept {
+    if (! isActive())
+        return 0;
+    switch (antialiasing) {
+        case Antialiasing::oversample2x: return static_cast<int> (std::lround (firstStage.getLatency()));
+        case Antialiasing::oversample4x: return static_cast<int> (std::lround (firstStage.getLatency() + 0.5 * secondStage.getLatency()));
+        case Antialiasing::none:
+        case Antialiasing::adaa:
+        default:                         return 0;
+    }
+}
+
+void FeedbackCharacter::saturate (float* samples, int numSamples) const noexcept {
+    for (int i = 0; i < numSamples; ++i)
+        samples[i] = clip (samples[i]);
+}
+
+void FeedbackCharacter::saturateAntiderivative (float* samples, int numSamples, float& previous) noexcept {
+    //y[n] = (F(x[n]) - F(x[n-1])) / (x[n] - x[n-1]), the average of the clipper over the step
+    //between samples, which takes out most of the aliasing for half a sample of delay
+    float* x = work.data(); //x[0] is the last sample of the previous call
+    x[0] = previous;
+    std::copy (samples, samples + numSamples, x + 1);
+    for (int i = 0; i < numSamples; ++i) {
+        const float a = x[i + 1], b = x[i];
+        const float difference = a - b;
+        const bool steep = std::abs (difference) > CHARACTER_ADAA_THRESHOLD;
+        const float averaged = (clipAntiderivative (a) - clipAntiderivative (b)) / (steep ? difference : 1.0f);
+        samples[i] = steep ? averaged : clip (0.5f * (a + b));
+    }
+    previous = x[numSamples];
+}
+
+void FeedbackCharacter::process (float* const* block, int numChannels, int startSample, int numSamples) noexcept {
+    numChannels = std::min (numChannels, numPreparedChannels);
+    for (int offset = 0; offset < numSamples;) {
+        const int length = driveGain.getNumSamplesAtCurrentStep (std::min (chunkSize, numSamples - offset));
+        const float gain = driveGain.getCurrentValue(), gainStep = driveGain.getStep();
+
+        for (int ch = 0; ch < numChannels; ++ch) {
+            float* x = block[ch] + startSample + offset;
+
+            if (toneCoefficient < 1.0f) {
+                float state = toneState[static_cast<size_t> (ch)];
+                for (int i = 0; i < length; ++i)
+                    x[i] = state += toneCoefficient * (x[i] - state);
+                toneState[static_cast<size_t> (ch)] = state;
+            }
+
+            for (int i = 0; i < length; ++i)
+                x[i] *= gain + gainStep * static_cast<float> (i);
+
+            switch (antialiasing) {
+                case Antialiasing::none:
+                    saturate (x, length);
+                    break;
+                case Antialiasing::oversample2x:
+                    firstStage.upsample (ch, x, upsampled.data(), length);
+                    saturate (upsampled.data(), 2 * length);
+                    firstStage.downsample (ch, upsampled.data(), x, length);
+                    break;
+                case Antialiasing::oversample4x:
+                    firstStage.upsample (ch, x, upsampled.data(), length);
+                    secondStage.upsample (ch, upsampled.data(), upsampledTwice.data(), 2 * length);
+                    saturate (upsampledTwice.data(), 4 * length);
+                    secondStage.downsample (ch, upsampledTwice.data(), upsampled.data(), 2 * length);
+                    firstStage.downsample (ch, upsampled.data(), x, length);
+                    break;
+                case Antialiasing::adaa:
+                default:
+                    saturateAntiderivative (x, length, adaaPrevious[static_cast<size_t> (ch)]);
+                    break;
+            }
+        }
+
+        driveGain.skip (length);
+        offset += length;
+    }
+}
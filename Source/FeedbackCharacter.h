@@ -0,0 +1,113 @@
+/*
+  ==============================================================================
+
+    FeedbackCharacter.h
+    Tone filter and soft saturation for the signal fed into the delay line.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "SmoothedParameter.h"
+
+#include <vector>
+
+//==============================================================================
+/**
+    The colour stage of the delay: a one-pole low-pass tone control, a drive
+    gain and a soft clipper, applied in place to the signal before it is
+    written into the line.
+
+    The clipper is a cubic that runs into a hard ceiling at 1.0. It has a
+    closed-form antiderivative, so it can alias in one of three ways, chosen
+    per instance:
+      - adaa: first-order antiderivative anti-aliasing at the base rate, which
+        costs almost nothing and adds half a sample of delay;
+      - oversample2x / oversample4x: the clipper runs at 2x or 4x inside
+        polyphase half-band FIR filters (one stage per doubling). This is
+        cleaner, but costs more and adds getLatencySamples() of delay, which
+        the caller should take off its delay times.
+
+    Everything works in fixed chunks on buffers sized in prepare(), so
+    process() never allocates. The filters and the clipper are plain array
+    loops that vectorise; the tone filter is recursive, so it runs sample by
+    sample per channel.
+*/
+class FeedbackCharacter
+{
+public:
+    enum class Antialiasing { none = 0, adaa, oversample2x, oversample4x };
+
+    /** process() works through a block this many samples at a time. */
+    static constexpr int chunkSize = 128;
+
+    FeedbackCharacter() = default;
+
+    /** Allocates the state for numChannels channels and clears it. */
+    void prepare (double sampleRate, int numChannels);
+
+    /** Clears the filter and oversampler state. */
+    void reset() noexcept;
+
+    /** Low-pass cutoff of the tone filter; at or above maxToneHz the filter is bypassed. */
+    void setTone (float cutoffHz) noexcept;
+
+    /** Gain into the clipper, ramped to avoid zipper noise. 0 dB still rounds off peaks near full scale. */
+    void setDrive (float decibels) noexcept;
+
+    /** Switching clears the oversampler state, so do it between notes rather than per block. */
+    void setAntialiasing (Antialiasing mode) noexcept;
+
+    Antialiasing getAntialiasing() const noexcept { return antialiasing; }
+
+    /** False when the tone is open and there's no drive: the stage would only
+        round off peaks, so callers can skip it and write the block straight in.
+    */
+    bool isActive() const noexcept;
+
+    /** Delay added by the oversampling filters, rounded to whole samples (0 when inactive). */
+    int getLatencySamples() const noexcept;
+
+    /** Colours samples [startSample, startSample + numSamples) of the first numChannels channels. */
+    void process (float* const* block, int numChannels, int startSample, int numSamples) noexcept;
+
+    static constexpr float maxToneHz = 20000.0f;
+
+private:
+    /** One doubling of the sample rate: a half-band low-pass split into its two
+        polyphase branches, with the history each channel needs going up and down.
+    */
+    struct HalfbandStage
+    {
+        void design (int numSideTaps);
+        void prepare (int numChannels);
+        void reset() noexcept;
+
+        /** numSamples in, 2 * numSamples out. */
+        void upsample (int channel, const float* in, float* out, int numSamples) noexcept;
+
+        /** 2 * numSamples in, numSamples out. */
+        void downsample (int channel, const float* in, float* out, int numSamples) noexcept;
+
+        /** Delay of one trip up and down, in samples at the lower rate. */
+        double getLatency() const noexcept { return 0.5 * static_cast<double> (length - 1); }
+
+        std::vector<float> sideTaps;     //the even-indexed taps of the causal filter; the odd ones are zero but the centre
+        int length = 0;                  //full filter length, 4k - 1
+        std::vector<float> upHistory, downHistory;
+        std::vector<float> scratch, evenPhase, oddPhase, accumulator; //one chunk with its history prepended
+    };
+
+    void saturate (float* samples, int numSamples) const noexcept;
+    void saturateAntiderivative (float* samples, int numSamples, float& previous) noexcept;
+
+    double sampleRate = 44100.0;
+    int numPreparedChannels = 0;
+    Antialiasing antialiasing = Antialiasing::adaa;
+    float toneHz = maxToneHz, toneCoefficient = 1.0f;
+    SmoothedParameter driveGain;
+    std::vector<float> toneState, adaaPrevious;
+    HalfbandStage firstStage, secondStage;
+    std::vector<float> work, upsampled, upsampledTwice; //chunk buffers at 1x, 2x and 4x
+};
@@ -0,0 +1,205 @@
+/*
+  ==============================================================================
+
+    FeedbackDelayNetwork.cpp
+
+  ==============================================================================
+*/
+
+#include "FeedbackDelayNetwork.h"
+
+#include <cmath>
+
+#define FDN_SHORTEST_LINE_SECONDS 0.023
+#define FDN_LONGEST_LINE_SECONDS 0.083
+
+namespace
+{
+    bool isPrime (int n) noexcept {
+        if (n < 2) return false;
+        for (int d = 2; d * d <= n; ++d)
+            if (n % d == 0) return false;
+        return true;
+    }
+
+    //+1 or -1: entry (row, column) of the unnormalised Hadamard matrix
+    float hadamardSign (int row, int column) noexcept {
+        int bits = row & column, parity = 0;
+        while (bits != 0) {
+            parity ^= 1;
+            bits &= bits - 1;
+        }
+        return parity ? -1.0f : 1.0f;
+    }
+}
+
+void FeedbackDelayNetwork::prepare (double sampleRate) {
+    currentSampleRate = sampleRate;
+
+    //spread the lengths geometrically, then move each up to a distinct prime so
+    //they're mutually prime and the echo patterns of different lines never line up
+    int previous = 0;
+    for (int k = 0; k < maxLines; ++k) {
+        const double position = static_cast<double> (k) / (maxLines - 1);
+        const double seconds = FDN_SHORTEST_LINE_SECONDS
+                             * std::pow (FDN_LONGEST_LINE_SECONDS / FDN_SHORTEST_LINE_SECONDS, position);
+        int length = std::max (previous + 1, static_cast<int> (seconds * sampleRate));
+        while (! isPrime (length))
+            ++length;
+        delays[static_cast<size_t> (k)] = previous = length;
+    }
+    longestLine = previous;
+
+    //interleave short and long lines so the first 8 still cover the whole range
+    std::array<int, maxLines> sorted = delays;
+    for (int k = 0; k < maxLines; ++k)
+        delays[static_cast<size_t> (k)] = sorted[static_cast<size_t> ((k % 2 == 0) ? k / 2 : maxLines - 1 - k / 2)];
+
+    if (isAllocated())
+        allocate(); //a new rate needs new lengths
+    outputs.resize (static_cast<size_t> (maxLines * chunkSize));
+    mix.resize (static_cast<size_t> (maxLines * chunkSize));
+    withInstructionSet (getActiveInstructionSet(), [this] (auto target) {
+        using Target = decltype (target);
+        floatKernel = &FeedbackDelayNetwork::processWith<Target, float>;
+        doubleKernel = &FeedbackDelayNetwork::processWith<Target, double>;
+    });
+    updateGains();
+}
+
+void FeedbackDelayNetwork::allocate() {
+    lines.setSize (maxLines, longestLine);
+}
+
+void FeedbackDelayNetwork::clear() {
+    lines.clear();
+}
+
+void FeedbackDelayNetwork::release() {
+    lines.release();
+}
+
+size_t FeedbackDelayNetwork::getMemoryUsage() const noexcept {
+    return lines.getMemoryUsage() + (outputs.capacity() + mix.capacity()) * sizeof (float);
+}
+
+void FeedbackDelayNetwork::setNumLines (int newNumLines) noexcept {
+    newNumLines = newNumLines > 12 ? 16 : 8;
+
+    //lines left out aren't written while the head moves on, so what they held the last time they played would come
+    //back as a burst of stale reverb: they start again from silence
+    if (newNumLines > numLines && isAllocated())
+        for (int k = numLines; k < newNumLines; ++k)
+            std::fill_n (lines.getChannel (k), lines.getCapacity(), 0.0f);
+    numLines = newNumLines;
+}
+
+void FeedbackDelayNetwork::setDecayTime (float rt60Seconds) noexcept {
+    rt60Seconds = std::max (0.01f, rt60Seconds);
+    if (rt60Seconds == decayTime)
+        return;
+
+    decayTime = rt60Seconds;
+    updateGains();
+}
+
+void FeedbackDelayNetwork::updateGains() noexcept {
+    if (currentSampleRate <= 0.0)
+        return;
+
+    //-60 dB after rt60 seconds: a line of d samples may keep 10^(-3 d / (rt60 * fs)) per pass
+    for (int k = 0; k < maxLines; ++k)
+        gains[static_cast<size_t> (k)] = static_cast<float> (std::pow (10.0, -3.0 * delays[static_cast<size_t> (k)]
+                                                                               / (decayTime * currentSampleRate)));
+}
+
+template <typename SampleType>
+void FeedbackDelayNetwork::processInPlace (SampleType* const* block, int numChannels, int startSample, int numSamples,
+                                           float wetGain, float wetGainStep) noexcept {
+    if (numChannels <= 0 || lines.getCapacity() == 0)
+        return;
+
+    if constexpr (std::is_same_v<SampleType, double>)
+        (this->*doubleKernel) (block, numChannels, startSample, numSamples, wetGain, wetGainStep);
+    else
+        (this->*floatKernel) (block, numChannels, startSample, numSamples, wetGain, wetGainStep);
+}
+
+template <typename Target, typename SampleType>
+void FeedbackDelayNetwork::processWith (SampleType* const* block, int numChannels, int startSample, int numSamples,
+                                        float wetGain, float wetGainStep) noexcept {
+    Target::run ([&] {
+        const int n = numLines;
+        const float inputScale = 1.0f / static_cast<float> (numChannels);
+        const float norm = 1.0f / std::sqrt (static_cast<float> (n)); //makes the butterfly orthonormal
+        int lineDelays[maxLines];
+        for (int k = 0; k < n; ++k)
+            lineDelays[k] = lines.clampDelay (delays[static_cast<size_t> (k)]);
+
+        for (int chunkStart = 0; chunkStart < numSamples; chunkStart += chunkSize) {
+            const int chunkLength = std::min (chunkSize, numSamples - chunkStart);
+
+            //mono input for the chunk
+            std::fill (input.begin(), input.begin() + chunkLength, 0.0f);
+            for (int ch = 0; ch < numChannels; ++ch) {
+                const SampleType* in = block[ch] + startSample + chunkStart;
+                for (int i = 0; i < chunkLength; ++i)
+                    input[static_cast<size_t> (i)] += static_cast<float> (in[i]) * inputScale;
+            }
+
+            lines.forEachSegment (chunkLength, lineDelays, n, [&] (int writeIndex, int offset, int length) {
+                //read every line and apply its decay
+                for (int k = 0; k < n; ++k) {
+                    const float* src = lines.getChannel (k) + lines.readIndex (writeIndex, lineDelays[k]);
+                    float* out = outputs.data() + k * chunkSize + offset;
+                    float* m = mix.data() + k * chunkSize + offset;
+                    const float g = gains[static_cast<size_t> (k)] * norm;
+                    for (int i = 0; i < length; ++i) {
+                        out[i] = src[i];
+                        m[i] = src[i] * g;
+                    }
+                }
+
+                //Hadamard butterfly across the lines, vectorised over the segment
+                for (int half = 1; half < n; half <<= 1) {
+                    for (int base = 0; base < n; base += 2 * half) {
+                        for (int k = base; k < base + half; ++k) {
+                            float* a = mix.data() + k * chunkSize + offset;
+                            float* b = mix.data() + (k + half) * chunkSize + offset;
+                            for (int i = 0; i < length; ++i) {
+                                const float x = a[i], y = b[i];
+                                a[i] = x + y;
+                                b[i] = x - y;
+                            }
+                        }
+                    }
+                }
+
+                //feed the mix back in, with the input added at alternating polarity
+                const float* in = input.data() + offset;
+                for (int k = 0; k < n; ++k) {
+                    float* dst = lines.getChannel (k) + writeIndex;
+                    const float* m = mix.data() + k * chunkSize + offset;
+                    const float sign = (k % 2 == 0) ? 1.0f : -1.0f;
+                    for (int i = 0; i < length; ++i)
+                        dst[i] = m[i] + sign * in[i];
+                }
+            });
+
+            //each channel hears a different Hadamard row of the line outputs, so channels decorrelate
+            const float chunkGain = wetGain + wetGainStep * static_cast<float> (chunkStart);
+            for (int ch = 0; ch < numChannels; ++ch) {
+                SampleType* io = block[ch] + startSample + chunkStart;
+                for (int k = 0; k < n; ++k) {
+                    const float* out = outputs.data() + k * chunkSize;
+                    const float sign = hadamardSign (ch % n, k) * norm;
+                    for (int i = 0; i < chunkLength; ++i)
+                        io[i] += static_cast<SampleType> (sign * (chunkGain + wetGainStep * static_cast<float> (i)) * out[i]);
+                }
+            }
+        }
+    });
+}
+
+template void FeedbackDelayNetwork::processInPlace<float> (float* const*, int, int, int, float, float) noexcept;
+template void FeedbackDelayNetwork::processInPlace<double> (double* const*, int, int, int, float, float) noexcept;
@@ -0,0 +1,105 @@
+/*
+  ==============================================================================
+
+    FeedbackDelayNetwork.h
+    Reverb made of mutually prime delay lines mixed through a Hadamard matrix.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "DelayLine.h"
+
+#include <array>
+
+//==============================================================================
+/**
+    A feedback delay network built on DelayLine: each line is one channel of the
+    same multichannel ring buffer, read at its own delay.
+
+    The lines are processed in short chunks (never longer than the shortest
+    line, so nothing written in a chunk is read back in it). For every chunk the
+    line outputs are read as vectors, scaled by their decay gains and mixed with
+    a fast Walsh-Hadamard butterfly: log2(N) stages of vector add/subtract rather
+    than an N x N matrix multiply, so the cost per sample grows with N log N and
+    the loops run over time, where they vectorise. prepare() picks the copy of
+    those loops built for getActiveInstructionSet().
+*/
+class FeedbackDelayNetwork
+{
+public:
+    static constexpr int maxLines = 16;
+
+    FeedbackDelayNetwork() = default;
+
+    /** Picks the line lengths for this sample rate and allocates the chunk buffers. The
+        lines themselves are only resized if they're held already: otherwise they stay
+        empty (and the network silent) until allocate(), or until the caller has them
+        sized off the audio thread through getLines().
+    */
+    void prepare (double sampleRate);
+
+    /** Sizes the lines for the lengths picked by prepare() (allocates). */
+    void allocate();
+
+    /** True once the lines hold storage. */
+    bool isAllocated() const noexcept   { return lines.getCapacity() > 0; }
+
+    /** The lines, as one DelayLine of maxLines channels, getLongestLine() long: for a
+        DelayLineResizer to allocate or free them without the audio thread doing it.
+    */
+    DelayLine& getLines() noexcept      { return lines; }
+
+    int getLongestLine() const noexcept { return longestLine; }
+
+    void clear();
+
+    /** Gives the line storage back to the DelayBufferPool; prepare() before using it again. */
+    void release();
+
+    /** 8 or 16; other values are rounded to the nearest of the two. Lines that come back on are cleared first. */
+    void setNumLines (int numLines) noexcept;
+
+    int getNumLines() const noexcept    { return numLines; }
+
+    /** Bytes held by the lines and the chunk buffers. */
+    size_t getMemoryUsage() const noexcept;
+
+    /** Sets each line's gain so the tail falls by 60 dB after rt60Seconds. */
+    void setDecayTime (float rt60Seconds) noexcept;
+
+    /** Feeds the mono sum of the first numChannels channels into the network and
+        adds the reverb back into every channel, scaled by wetGain + wetGainStep * i.
+        Instantiated for float and double blocks; the network itself runs in float.
+    */
+    template <typename SampleType>
+    void processInPlace (SampleType* const* block, int numChannels, int startSample, int numSamples,
+                         float wetGain, float wetGainStep) noexcept;
+
+private:
+    static constexpr int chunkSize = 64;
+
+    template <typename SampleType>
+    using Kernel = void (FeedbackDelayNetwork::*) (SampleType* const*, int, int, int, float, float) noexcept;
+
+    /** processInPlace() itself, compiled for one instruction set. */
+    template <typename Target, typename SampleType>
+    void processWith (SampleType* const* block, int numChannels, int startSample, int numSamples,
+                      float wetGain, float wetGainStep) noexcept;
+
+    void updateGains() noexcept;
+
+    DelayLine lines;
+    double currentSampleRate = 0.0;
+    int numLines = 8;
+    int longestLine = 0;
+    float decayTime = 2.0f;
+    std::array<int, maxLines> delays {};
+    std::array<float, maxLines> gains {};
+    std::vector<float> outputs; //maxLines x chunkSize: what each line produced this chunk
+    std::vector<float> mix;     //maxLines x chunkSize: the same, after decay and the Hadamard butterfly
+    std::array<float, chunkSize> input {};
+    Kernel<float> floatKernel = nullptr;     //set by prepare()
+    Kernel<double> doubleKernel = nullptr;
+};
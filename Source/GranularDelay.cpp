@@ -0,0 +1,214 @@
+/*
+  ==============================================================================
+
+    GranularDelay.cpp
+
+  ==============================================================================
+*/
+
+#include "GranularDelay.h"
+
+#include <cmath>
+
+void GranularDelay::prepare (int numChannels) {
+    if (window.empty()) {
+        window.resize (windowSize + 1);
+        for (int i = 0; i <= windowSize; ++i)
+            window[static_cast<size_t> (i)] = 0.5f - 0.5f * static_cast<float> (std::cos (2.0 * 3.14159265358979323846 * i / windowSize));
+    }
+
+    numChannels = std::max (0, numChannels);
+    wet.assign (static_cast<size_t> (numChannels) * chunkSize, 0.0f);
+    send.assign (static_cast<size_t> (numChannels) * chunkSize, 0.0f);
+    wetChannels.resize (static_cast<size_t> (numChannels));
+    sendChannels.resize (static_cast<size_t> (numChannels));
+    for (int ch = 0; ch < numChannels; ++ch) {
+        wetChannels[static_cast<size_t> (ch)] = wet.data() + static_cast<size_t> (ch) * chunkSize;
+        sendChannels[static_cast<size_t> (ch)] = send.data() + static_cast<size_t> (ch) * chunkSize;
+    }
+    reset();
+}
+
+void GranularDelay::reset() noexcept {
+    freeList = nullptr;
+    for (int i = maxGrains - 1; i >= 0; --i) {
+        grains[static_cast<size_t> (i)].next = freeList;
+        freeList = &grains[static_cast<size_t> (i)];
+    }
+    active = nullptr;
+    numActive = 0;
+    samplesToNextGrain = 0.0f;
+}
+
+void GranularDelay::release() {
+    reset();
+    window = {};
+    wet = {};
+    send = {};
+    wetChannels = {};
+    sendChannels = {};
+}
+
+void GranularDelay::setSettings (const Settings& newSettings) noexcept {
+    settings = newSettings;
+    settings.grainSamples = std::max (1.0f, settings.grainSamples);
+    settings.rate = std::clamp (settings.rate, 1.0f / maxRate, maxRate);
+    settings.shimmer = std::clamp (settings.shimmer, 0.0f, 0.99f);
+
+    //grains that all read the same stretch add up coherently, to overlap / 2 Hann windows; random ones add up in power.
+    //one over the square root sits between the two for the output, and the shimmer is scaled by it once more, so even
+    //the coherent sum goes back into the line below unity and the loop always decays
+    const float overlap = settings.grainSamples * settings.grainsPerSample;
+    grainGain = 1.0f / std::sqrt (std::max (1.0f, overlap * 0.5f));
+}
+
+int GranularDelay::getReach (const Settings& settings) noexcept {
+    //the oldest sample a grain reads: its starting delay (pushed back for grains that read ahead), plus what a slow or
+    //reversed one falls behind over its length
+    const float slowest = settings.reverseProbability > 0.0f ? -settings.rate : settings.rate;
+    const float start = std::max (settings.delaySamples + settings.spraySamples,
+                                  std::max (0.0f, settings.rate - 1.0f) * settings.grainSamples + chunkSize + 2);
+    return static_cast<int> (start + std::max (0.0f, 1.0f - slowest) * settings.grainSamples) + 2;
+}
+
+size_t GranularDelay::getMemoryUsage() const noexcept {
+    return (window.capacity() + wet.capacity() + send.capacity()) * sizeof (float);
+}
+
+GranularDelay::Grain* GranularDelay::allocate() noexcept {
+    Grain* grain = freeList;
+    if (grain != nullptr) {
+        freeList = grain->next;
+        grain->next = active;
+        active = grain;
+        ++numActive;
+    }
+    return grain;
+}
+
+float GranularDelay::nextRandom() noexcept {
+    //xorshift: cheap, allocation free, and the same cloud every time for the same input
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return static_cast<float> (randomState >> 8) * (1.0f / 16777216.0f);
+}
+
+//starts a grain at sample offset of the current chunk
+void GranularDelay::spawn (const DelayLine& line, int offset) noexcept {
+    const float rate = nextRandom() < settings.reverseProbability ? -settings.rate : settings.rate;
+    const int length = static_cast<int> (settings.grainSamples);
+
+    //its delay is kept where every sample it reads has been written before the chunk that reads it, and is still in
+    //the line by then: a grain that reads ahead needs history to read into, a reversed one room to fall back into
+    const double minAge = std::max (0.0f, rate - 1.0f) * static_cast<double> (length) + chunkSize + 2;
+    const double maxAge = line.getCapacity() - 2 - std::max (0.0f, 1.0f - rate) * static_cast<double> (length);
+    const double age = settings.delaySamples + settings.spraySamples * nextRandom();
+    if (maxAge < minAge)
+        return; //the line hasn't grown enough for this grain yet
+
+    Grain* grain = allocate();
+    if (grain == nullptr)
+        return;
+
+    grain->position = static_cast<double> (line.getWriteCount() + offset) - std::clamp (age, minAge, maxAge);
+    grain->rate = rate;
+    grain->windowPosition = 0.0f;
+    grain->windowStep = static_cast<float> (windowSize) / static_cast<float> (length);
+    grain->remaining = length;
+    grain->wait = offset;
+}
+
+//adds every active grain into wet for the chunk, and frees those that end in it
+void GranularDelay::renderChunk (const DelayLine& line, int numChannels, int numSamples) noexcept {
+    for (Grain** link = &active; *link != nullptr;) {
+        Grain& grain = **link;
+        const int first = grain.wait;
+        const int count = std::min (numSamples - first, grain.remaining);
+
+        //the window and the read positions are the same for every channel, so they're worked out once. positions are
+        //relative to the oldest sample the grain reads this chunk
+        const double start = grain.position;
+        const double end = start + grain.rate * (count - 1);
+        const auto oldest = static_cast<int64_t> (std::floor (std::min (start, end)));
+        const int spanLength = static_cast<int> (static_cast<int64_t> (std::floor (std::max (start, end))) - oldest) + 2;
+        for (int i = 0; i < count; ++i) {
+            const float w = grain.windowPosition + grain.windowStep * static_cast<float> (i);
+            const int k = std::min (static_cast<int> (w), windowSize - 1);
+            const float* entry = window.data() + k;
+            gains[static_cast<size_t> (i)] = grainGain * (entry[0] + (w - static_cast<float> (k)) * (entry[1] - entry[0]));
+            const double p = start + grain.rate * i;
+            const double whole = std::floor (p);
+            offsets[static_cast<size_t> (i)] = static_cast<int> (static_cast<int64_t> (whole) - oldest);
+            fractions[static_cast<size_t> (i)] = static_cast<float> (p - whole);
+        }
+
+        for (int ch = 0; ch < numChannels; ++ch) {
+            line.readSamples (ch, oldest, spanLength, span.data());
+            float* out = wetChannels[static_cast<size_t> (ch)] + first;
+            for (int i = 0; i < count; ++i) {
+                const float* s = span.data() + offsets[static_cast<size_t> (i)];
+                out[i] += gains[static_cast<size_t> (i)] * (s[0] + fractions[static_cast<size_t> (i)] * (s[1] - s[0]));
+            }
+        }
+
+        grain.position += grain.rate * count;
+        grain.windowPosition += grain.windowStep * static_cast<float> (count);
+        grain.remaining -= count;
+        grain.wait = 0;
+        if (grain.remaining > 0) {
+            link = &grain.next;
+        } else {
+            *link = grain.next;
+            grain.next = freeList;
+            freeList = &grain;
+            --numActive;
+        }
+    }
+}
+
+template <typename SampleType>
+void GranularDelay::processInPlace (DelayLine& line, SampleType* const* block, int numChannels, int startSample, int numSamples,
+                                    float inputGain, float inputGainStep, const float* const* lineInput) noexcept {
+    numChannels = std::min ({ numChannels, line.getNumChannels(), static_cast<int> (wetChannels.size()) });
+    if (numChannels <= 0 || line.getCapacity() == 0)
+        return;
+
+    //the line was cleared, restored or played by another mode since the last block: the grains' audio is gone
+    if (line.getWriteCount() != expectedWriteCount)
+        reset();
+
+    const float shimmerGain = settings.shimmer * grainGain;
+    for (int chunkStart = 0; chunkStart < numSamples; chunkStart += chunkSize) {
+        const int length = std::min (chunkSize, numSamples - chunkStart);
+        for (int ch = 0; ch < numChannels; ++ch)
+            std::fill_n (wetChannels[static_cast<size_t> (ch)], length, 0.0f);
+
+        //grains start on their own sample, however the block is cut
+        if (settings.grainsPerSample > 0.0f) {
+            for (; samplesToNextGrain < static_cast<float> (length); samplesToNextGrain += 1.0f / settings.grainsPerSample)
+                spawn (line, static_cast<int> (samplesToNextGrain));
+            samplesToNextGrain -= static_cast<float> (length);
+        }
+        renderChunk (line, numChannels, length);
+
+        //the input (read before the grains are added) and the shimmer go into the line, the grains into the block
+        const float chunkGain = inputGain + inputGainStep * static_cast<float> (chunkStart);
+        for (int ch = 0; ch < numChannels; ++ch) {
+            SampleType* io = block[ch] + startSample + chunkStart;
+            const float* in = lineInput != nullptr ? lineInput[ch] + chunkStart : nullptr;
+            const float* grainsOut = wetChannels[static_cast<size_t> (ch)];
+            float* toLine = sendChannels[static_cast<size_t> (ch)];
+            for (int i = 0; i < length; ++i) {
+                const float dry = in != nullptr ? in[i] : static_cast<float> (io[i]);
+                toLine[i] = dry * (chunkGain + inputGainStep * static_cast<float> (i)) + shimmerGain * grainsOut[i];
+                io[i] += static_cast<SampleType> (grainsOut[i]);
+            }
+        }
+        line.write (sendChannels.data(), numChannels, length);
+    }
+    expectedWriteCount = line.getWriteCount();
+}
+
+template void GranularDelay::processInPlace<float> (DelayLine&, float* const*, int, int, int, float, float, const float* const*) noexcept;
+template void GranularDelay::processInPlace<double> (DelayLine&, double* const*, int, int, int, float, float, const float* const*) noexcept;
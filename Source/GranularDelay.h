@@ -0,0 +1,123 @@
+/*
+  ==============================================================================
+
+    GranularDelay.h
+    Windowed grains read back out of a DelayLine: reverse echoes, pitch
+    shifting and shimmer.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "DelayLine.h"
+
+#include <array>
+#include <vector>
+
+//==============================================================================
+/**
+    A cloud of grains played from a DelayLine it doesn't own (the processor's),
+    which it also writes the input into, so the granular mode shares the line,
+    its growing and its saved tail with the other modes.
+
+    Every grain is a Hann-windowed read of every channel at the same position,
+    moving through the line at its own rate: 1 is a plain echo, 2 an octave up,
+    negative rates play backwards. New grains start at a steady rate (the
+    density), each reading from the delay plus a random amount of spray, and
+    reversed with a given probability. With shimmer above zero the grains are
+    written back into the line too, so every repeat is pitched again.
+
+    Nothing is allocated while processing: grains come from a fixed pool of
+    maxGrains with an intrusive free list (a full pool skips new grains), and
+    the window is a table built by prepare(). Blocks are processed in chunks of
+    chunkSize, which is also how close to the write head a grain may read, so a
+    chunk's grains only read samples written before it. Per chunk, each grain
+    works out its window and read positions once, then runs one plain loop per
+    channel over a decoded copy of the stretch of line it reads.
+*/
+class GranularDelay
+{
+public:
+    static constexpr int maxGrains = 256;
+    static constexpr int chunkSize = 64;
+    static constexpr float maxRate = 4.0f; //two octaves either way
+
+    struct Settings
+    {
+        float delaySamples = 0.0f;      //how far back a grain starts reading, before spray
+        float grainSamples = 0.0f;      //the length of a grain, at the output
+        float grainsPerSample = 0.0f;   //density
+        float spraySamples = 0.0f;      //up to this much is added to each grain's delay at random
+        float rate = 1.0f;              //playback rate of forward grains; reversed ones play at -rate
+        float reverseProbability = 0.0f;
+        float shimmer = 0.0f;           //how much of the grains goes back into the line, below 1
+    };
+
+    GranularDelay() = default;
+
+    /** Sizes the buffers for numChannels and builds the window table (allocates). */
+    void prepare (int numChannels);
+
+    /** Returns every grain to the pool. */
+    void reset() noexcept;
+
+    /** Frees the buffers; prepare() before using it again. */
+    void release();
+
+    void setSettings (const Settings& newSettings) noexcept;
+
+    /** How far back a grain with these settings can read, which the line has to hold. */
+    static int getReach (const Settings& settings) noexcept;
+
+    int getNumActiveGrains() const noexcept { return numActive; }
+
+    size_t getMemoryUsage() const noexcept;
+
+    /** Adds the grains into samples [startSample, startSample + numSamples) of the
+        first numChannels channels of block, and writes the block (or lineInput, if
+        given, like DelayLine::processInPlace) scaled by inputGain + inputGainStep * i
+        into line, plus the grains scaled by the shimmer. Moves the line's head on.
+    */
+    template <typename SampleType>
+    void processInPlace (DelayLine& line, SampleType* const* block, int numChannels, int startSample, int numSamples,
+                         float inputGain, float inputGainStep, const float* const* lineInput = nullptr) noexcept;
+
+private:
+    static constexpr int windowSize = 1024;
+    static constexpr int maxSpan = static_cast<int> (chunkSize * maxRate) + 3; //line samples one grain reads per chunk
+
+    struct Grain
+    {
+        Grain* next = nullptr;  //in the free list or the active list
+        double position = 0.0;  //the line sample (as a write count) the grain reads next
+        float rate = 1.0f;
+        float windowPosition = 0.0f, windowStep = 0.0f; //in table entries
+        int remaining = 0;      //output samples left
+        int wait = 0;           //samples of the current chunk before it starts
+    };
+
+    Grain* allocate() noexcept;
+    void spawn (const DelayLine& line, int offset) noexcept;
+    void renderChunk (const DelayLine& line, int numChannels, int numSamples) noexcept;
+    float nextRandom() noexcept;
+
+    std::array<Grain, maxGrains> grains;
+    Grain* freeList = nullptr;
+    Grain* active = nullptr;
+    int numActive = 0;
+
+    Settings settings;
+    float grainGain = 1.0f; //keeps a dense cloud at about the level of a single stream of grains
+    float samplesToNextGrain = 0.0f;
+    int64_t expectedWriteCount = -1; //where the line should be: anything else means it was cleared or restored
+    uint32_t randomState = 0x9e3779b9u;
+
+    std::vector<float> window;  //windowSize + 1 entries, the last repeating the first
+    std::vector<float> wet;     //numChannels x chunkSize: the grains of the current chunk
+    std::vector<float> send;    //numChannels x chunkSize: what goes into the line
+    std::vector<float*> wetChannels, sendChannels;
+    std::array<float, maxSpan> span {};
+    std::array<float, chunkSize> gains {}, fractions {};
+    std::array<int, chunkSize> offsets {};
+};
@@ -0,0 +1,52 @@
+/*
+  ==============================================================================
+
+    InstructionSet.cpp
+
+  ==============================================================================
+*/
+
+#include "InstructionSet.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace
+{
+    std::atomic<InstructionSet> instructionSetLimit { InstructionSet::avx512 };
+}
+
+InstructionSet getSupportedInstructionSet() noexcept {
+   #if MYGREATPROJECT_X86_DISPATCH
+    //__builtin_cpu_supports also checks that the OS saves the wider registers
+    static const InstructionSet supported = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports ("avx512f") && __builtin_cpu_supports ("avx512bw")
+            && __builtin_cpu_supports ("avx512dq") && __builtin_cpu_supports ("avx512vl"))
+            return InstructionSet::avx512;
+        if (__builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma"))
+            return InstructionSet::avx2;
+        return InstructionSet::baseline;
+    }();
+    return supported;
+   #else
+    return InstructionSet::baseline;
+   #endif
+}
+
+InstructionSet getActiveInstructionSet() noexcept {
+    return std::min (getSupportedInstructionSet(), instructionSetLimit.load (std::memory_order_relaxed));
+}
+
+void limitInstructionSet (InstructionSet maximum) noexcept {
+    instructionSetLimit.store (maximum, std::memory_order_relaxed);
+}
+
+const char* getInstructionSetName (InstructionSet level) noexcept {
+    switch (level) {
+        case InstructionSet::avx512:   return "avx512";
+        case InstructionSet::avx2:     return "avx2";
+        case InstructionSet::baseline:
+        default:                       return "baseline";
+    }
+}
@@ -0,0 +1,88 @@
+/*
+  ==============================================================================
+
+    InstructionSet.h
+    Vector instruction sets the DSP kernels are built for, chosen at run time.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+//x86 builds with GCC or Clang carry AVX2 and AVX-512 copies of the kernels next to the baseline (SSE2) ones.
+//everywhere else there is only the baseline, which on arm64 (Apple silicon) already means NEON
+#if (defined (__GNUC__) || defined (__clang__)) && (defined (__x86_64__) || defined (__i386__))
+ #define MYGREATPROJECT_X86_DISPATCH 1
+#else
+ #define MYGREATPROJECT_X86_DISPATCH 0
+#endif
+
+//==============================================================================
+/** In increasing order, so a level supports everything below it. */
+enum class InstructionSet
+{
+    baseline = 0,   //whatever the build targets: SSE2 on x86-64, NEON on arm64
+    avx2,           //AVX2 and FMA
+    avx512          //AVX-512 F, BW, DQ and VL
+};
+
+/** The best level this CPU and OS support, detected once. */
+InstructionSet getSupportedInstructionSet() noexcept;
+
+/** What kernels selected now will use: the supported level, capped by limitInstructionSet(). */
+InstructionSet getActiveInstructionSet() noexcept;
+
+/** Caps the level kernels may use, e.g. to benchmark the baseline path on an
+    AVX-512 machine; InstructionSet::avx512 (the default) lifts the cap. Kernels
+    pick the change up the next time they are selected, in DelayLine::setSize()
+    and FeedbackDelayNetwork::prepare(), which prepareToPlay calls.
+*/
+void limitInstructionSet (InstructionSet maximum) noexcept;
+
+const char* getInstructionSetName (InstructionSet level) noexcept;
+
+//==============================================================================
+/*
+    One tag per level. Target::run (fn) calls fn compiled for that level: run is
+    built with the level's target attribute and flattened, so fn and everything
+    it calls are inlined into it and its loops are vectorised for that level.
+    Kernels wrap their bodies in it, and are instantiated once per tag.
+*/
+struct BaselineTarget
+{
+    static constexpr InstructionSet level = InstructionSet::baseline;
+
+    template <typename Function>
+    static void run (Function&& fn) noexcept { fn(); }
+};
+
+#if MYGREATPROJECT_X86_DISPATCH
+struct Avx2Target
+{
+    static constexpr InstructionSet level = InstructionSet::avx2;
+
+    template <typename Function>
+    __attribute__ ((target ("avx2,fma"), flatten)) static void run (Function&& fn) noexcept { fn(); }
+};
+
+struct Avx512Target
+{
+    static constexpr InstructionSet level = InstructionSet::avx512;
+
+    template <typename Function>
+    __attribute__ ((target ("avx512f,avx512bw,avx512dq,avx512vl,avx2,fma"), flatten)) static void run (Function&& fn) noexcept { fn(); }
+};
+#endif
+
+/** Calls fn with the tag for the given level (the baseline where a level isn't built). */
+template <typename Function>
+void withInstructionSet (InstructionSet level, Function&& fn) {
+    switch (level) {
+       #if MYGREATPROJECT_X86_DISPATCH
+        case InstructionSet::avx512:   fn (Avx512Target {});   break;
+        case InstructionSet::avx2:     fn (Avx2Target {});     break;
+       #endif
+        case InstructionSet::baseline:
+        default:                       fn (BaselineTarget {}); break;
+    }
+}
@@ -9,17 +9,31 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
 
+#define EDITOR_FRAME_RATE 30
+#define METER_DECAY 0.85f //per frame, about 4.5 dB per 100 ms
+#define SCOPE_MIN_SECONDS 0.5f
+#define SCOPE_MAX_SECONDS 30.0f
+#define LOAD_TEXT_FRAMES 15 //the DSP load line is refreshed twice a second
+
 //==============================================================================
 MyGreatProjectAudioProcessorEditor::MyGreatProjectAudioProcessorEditor (MyGreatProjectAudioProcessor& p)
     : AudioProcessorEditor (&p), audioProcessor (p)
 {
     // Make sure that before the constructor has finished, you've set the
     // editor's size to whatever you need it to be.
+    setOpaque (true);
     setSize (400, 300);
+    updateStatusText();
+    audioProcessor.telemetry.setConsumerActive (true);
+    audioProcessor.profiler.setEnabled (true);
+    startTimerHz (EDITOR_FRAME_RATE);
 }
 
 MyGreatProjectAudioProcessorEditor::~MyGreatProjectAudioProcessorEditor()
 {
+    stopTimer();
+    audioProcessor.telemetry.setConsumerActive (false);
+    audioProcessor.profiler.setEnabled (false);
 }
 
 //==============================================================================
@@ -30,6 +44,168 @@ void MyGreatProjectAudioProcessorEditor::paint (juce::Graphics& g)
     g.fillAll (getLookAndFeel().findColour (juce::ResizableWindow::backgroundColourId));
     g.setColour (juce::Colours::white);
     g.setFont (juce::FontOptions (15.0f));
+    g.drawFittedText (statusText + "\n" + parameterText + "\n" + loadText, textArea, juce::Justification::centred, 8);
+
+    //the scope is already drawn; only the read head marker goes on top
+    g.drawImageAt (scope, scopeArea.getX(), scopeArea.getY());
+    if (scopeSeconds > 0.0f && latest.delaySeconds <= scopeSeconds) {
+        const float x = static_cast<float>(scopeArea.getRight()) - latest.delaySeconds / scopeSeconds * static_cast<float>(scopeArea.getWidth());
+        g.setColour (Colours::white.withAlpha (0.7f));
+        g.drawVerticalLine (static_cast<int>(x), static_cast<float>(scopeArea.getY()), static_cast<float>(scopeArea.getBottom()));
+    }
+
+    //input and output meters, side by side, filling from the bottom
+    const auto meter = [&] (Rectangle<int> area, float level, Colour colour) {
+        const int height = static_cast<int>(static_cast<float>(area.getHeight()) * std::min (1.0f, level));
+        g.setColour (colour);
+        g.fillRect (area.removeFromBottom (height));
+    };
+    auto meters = meterArea;
+    meter (meters.removeFromLeft (meterArea.getWidth() / 2).reduced (2), inputMeter, Colours::orange);
+    meter (meters.reduced (2), outputMeter, Colours::cyan);
+}
+
+void MyGreatProjectAudioProcessorEditor::resized()
+{
+    auto area = getLocalBounds().reduced (8);
+    textArea = area.removeFromTop (110);
+    meterArea = area.removeFromRight (24);
+    area.removeFromRight (8);
+    scopeArea = area;
+
+    //start the picture over at the new size
+    scope = juce::Image (juce::Image::RGB, std::max (1, scopeArea.getWidth()), std::max (1, scopeArea.getHeight()), true);
+    columns.assign (static_cast<size_t>(scope.getWidth()), {});
+    oldestColumn = 0;
+    secondsPerColumn = scopeSeconds / static_cast<double>(scope.getWidth());
+    newColumns = scope.getWidth();
+}
+
+void MyGreatProjectAudioProcessorEditor::timerCallback()
+{
+    //a bounded amount of work per frame, however far behind we are: at most one FIFO's worth of frames,
+    //and at most one image's worth of columns
+    const int count = audioProcessor.telemetry.pop (incoming.data(), static_cast<int>(incoming.size()));
+    float inputPeak = 0.0f, outputPeak = 0.0f;
+    for (int i = 0; i < count; ++i) {
+        const auto& frame = incoming[static_cast<size_t>(i)];
+        addToScope (frame);
+        inputPeak = std::max (inputPeak, frame.inputPeak);
+        outputPeak = std::max (outputPeak, frame.outputPeak);
+    }
+
+    if (newColumns > 0) {
+        drawColumns (static_cast<int>(columns.size()) - newColumns, newColumns);
+        newColumns = 0;
+        repaint (scopeArea);
+    }
+
+    const float newInputMeter = std::max (inputPeak, inputMeter * METER_DECAY);
+    const float newOutputMeter = std::max (outputPeak, outputMeter * METER_DECAY);
+    if (std::abs (newInputMeter - inputMeter) > 0.001f || std::abs (newOutputMeter - outputMeter) > 0.001f) {
+        inputMeter = newInputMeter;
+        outputMeter = newOutputMeter;
+        repaint (meterArea);
+    }
+
+    if (count > 0) {
+        const auto& frame = incoming[static_cast<size_t>(count - 1)];
+        const bool changed = frame.feedback != latest.feedback || frame.delaySeconds != latest.delaySeconds
+                          || frame.mode != latest.mode || frame.memoryBytes != latest.memoryBytes;
+        latest = frame;
+        if (changed) {
+            static const char* modeNames[] = { "Delay", "Multi-tap", "FDN reverb", "Granular" };
+            parameterText = juce::String (modeNames[juce::jlimit (0, 3, latest.mode)])
+                          + juce::String::formatted ("  %.3f s  feedback %.2f", latest.delaySeconds, latest.feedback);
+            updateStatusText();
+        }
+    }
+
+    if (audioProcessor.tests.size() != numTestsShown)
+        updateStatusText();
+
+    if (++framesSinceLoadText >= LOAD_TEXT_FRAMES) {
+        framesSinceLoadText = 0;
+        updateLoadText();
+    }
+}
+
+void MyGreatProjectAudioProcessorEditor::updateLoadText()
+{
+    //time spent in processBlock as a share of the time the host allows for it, and which kernels spent it
+    const auto load = audioProcessor.profiler.getSummary();
+    const juce::String kernels (getInstructionSetName (getActiveInstructionSet()));
+    const auto text = load.blocks == 0 ? "DSP load (" + kernels + "): -"
+                                       : "DSP load (" + kernels + "): "
+                                         + juce::String::formatted ("p50 %d%%  p99 %d%%  max %d%%  overruns %lld",
+                                                                    juce::roundToInt (load.p50 * 100.0f), juce::roundToInt (load.p99 * 100.0f),
+                                                                    juce::roundToInt (load.max * 100.0f), static_cast<long long>(load.overruns));
+    if (text != loadText) {
+        loadText = text;
+        repaint (textArea);
+    }
+}
+
+void MyGreatProjectAudioProcessorEditor::addToScope (const TelemetryFrame& frame)
+{
+    //the span follows the delay time, so the read head stays on screen; it only changes when the
+    //delay moves by more than a quarter, and then the picture starts over at the new scale
+    const float wantedSeconds = juce::jlimit (SCOPE_MIN_SECONDS, SCOPE_MAX_SECONDS, frame.delaySeconds * 1.5f);
+    if (scopeSeconds <= 0.0f || wantedSeconds > scopeSeconds * 1.25f || wantedSeconds < scopeSeconds * 0.8f) {
+        scopeSeconds = wantedSeconds;
+        secondsPerColumn = scopeSeconds / static_cast<double>(std::max (1, scope.getWidth()));
+        std::fill (columns.begin(), columns.end(), Column {});
+        oldestColumn = 0;
+        newColumns = static_cast<int>(columns.size());
+        pending = {};
+        pendingSeconds = 0.0;
+    }
+
+    pending.linePeak = std::max (pending.linePeak, frame.linePeak);
+    pending.outputPeak = std::max (pending.outputPeak, frame.outputPeak);
+    pendingSeconds += frame.blockSeconds;
+    //a block longer than a column fills several with the same peak
+    while (pendingSeconds >= secondsPerColumn && ! columns.empty()) {
+        //the oldest column makes way for the new one
+        columns[oldestColumn] = pending;
+        oldestColumn = (oldestColumn + 1) % columns.size();
+        newColumns = std::min (newColumns + 1, static_cast<int>(columns.size()));
+        pendingSeconds -= secondsPerColumn;
+        if (pendingSeconds < secondsPerColumn)
+            pending = {};
+    }
+}
+
+void MyGreatProjectAudioProcessorEditor::drawColumns (int firstColumn, int numColumns)
+{
+    using namespace juce;
+    const int width = scope.getWidth(), height = scope.getHeight();
+    const int centre = height / 2;
+
+    //scroll what's there, then draw only the new columns at the right-hand edge
+    if (numColumns < width)
+        scope.moveImageSection (0, 0, numColumns, 0, width - numColumns, height);
+
+    Graphics g (scope);
+    const int x0 = width - numColumns;
+    g.setColour (Colours::black);
+    g.fillRect (x0, 0, numColumns, height);
+    for (int i = 0; i < numColumns; ++i) {
+        const auto& column = columns[(oldestColumn + static_cast<size_t>(firstColumn + i)) % columns.size()];
+        const int up = static_cast<int>(static_cast<float>(centre) * std::min (1.0f, column.linePeak));
+        const int down = static_cast<int>(static_cast<float>(height - centre) * std::min (1.0f, column.outputPeak));
+        g.setColour (Colours::orange);
+        g.fillRect (x0 + i, centre - up, 1, up);
+        g.setColour (Colours::cyan);
+        g.fillRect (x0 + i, centre, 1, down);
+    }
+}
+
+void MyGreatProjectAudioProcessorEditor::updateStatusText()
+{
+    using namespace juce;
+    //tests and messages are only written by runTests(), which runs on the message thread like this
+    numTestsShown = audioProcessor.tests.size();
     String str = "";
     for (const bool val : audioProcessor.tests) {
         str = str + String(static_cast<int>(val)) + " ";
@@ -39,13 +215,15 @@ void MyGreatProjectAudioProcessorEditor::paint (juce::Graphics& g)
     for (std::string str : audioProcessor.messages) {
         msg += "\n" + String(str);
     }
-    g.drawFittedText (msg, getLocalBounds(), juce::Justification::centred, 4);
-}
 
-void MyGreatProjectAudioProcessorEditor::resized()
-{
-    // This is generally where you'll want to lay out the positions of any
-    // subcomponents in your editor..
+    //delay memory: this instance, then the pool every instance in the process shares
+    const auto pool = audioProcessor.getBufferPoolStats();
+    const auto megabytes = [] (size_t bytes) { return String(static_cast<double>(bytes) / (1024.0 * 1024.0), 1) + " MB"; };
+    msg += "\nMemory: " + megabytes(latest.memoryBytes)
+         + "\nPool: " + megabytes(pool.bytesInUse) + " in " + String(pool.blocksInUse) + " blocks, "
+         + megabytes(pool.bytesIdle) + " idle in " + String(pool.blocksIdle);
+    statusText = msg;
+    repaint (textArea);
 }
 
 int MyGreatProjectAudioProcessorEditor::getMagicNumber() {
@@ -13,8 +13,19 @@
 
 //==============================================================================
 /**
+    Status text, level meters and a scrolling picture of the delay line: what
+    went into the line over the last few seconds, with a marker where the read
+    head is picking it up again. Each column is the line peak of the frames it
+    covers (see TelemetryFrame::linePeak), so the picture is a decimated copy of
+    the line's contents, colour and shimmer included, on top of the output.
+
+    Everything it shows comes from the processor's TelemetryFifo, drained by a
+    fixed-rate timer, so the editor never reads state the audio thread is
+    writing. The scope is a cached image that is scrolled and only has its new
+    columns drawn each frame, and only the regions that changed are repainted.
 */
-class MyGreatProjectAudioProcessorEditor  : public juce::AudioProcessorEditor
+class MyGreatProjectAudioProcessorEditor  : public juce::AudioProcessorEditor,
+                                            private juce::Timer
 {
 public:
     MyGreatProjectAudioProcessorEditor (MyGreatProjectAudioProcessor&);
@@ -26,9 +37,38 @@ public:
     static int getMagicNumber();
 
 private:
+    struct Column
+    {
+        float linePeak = 0.0f, outputPeak = 0.0f;
+    };
+
+    void timerCallback() override;
+    void addToScope (const TelemetryFrame& frame);
+    void drawColumns (int firstColumn, int numColumns);
+    void updateStatusText();
+    void updateLoadText();
+
     // This reference is provided as a quick way for your editor to
     // access the processor object that created it.
     MyGreatProjectAudioProcessor& audioProcessor;
 
+    std::array<TelemetryFrame, TelemetryFifo::capacity> incoming; //drained into here each frame
+
+    juce::Rectangle<int> textArea, scopeArea, meterArea;
+    juce::Image scope;              //one column per secondsPerColumn, newest on the right
+    std::vector<Column> columns;    //what's in the image, so it can be redrawn after a resize: a ring, oldest first from oldestColumn
+    size_t oldestColumn = 0;
+    int newColumns = 0;             //columns added since the last frame
+    Column pending;                 //the column being filled
+    double pendingSeconds = 0.0;
+    double secondsPerColumn = 0.0;
+    float scopeSeconds = 0.0f;      //time span across the scope, which follows the delay time
+
+    TelemetryFrame latest;
+    float inputMeter = 0.0f, outputMeter = 0.0f;
+    juce::String statusText, parameterText, loadText;
+    size_t numTestsShown = 0;
+    int framesSinceLoadText = 0;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MyGreatProjectAudioProcessorEditor)
 };
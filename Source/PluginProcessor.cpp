@@ -10,9 +10,72 @@
 
 #include "JuceHeader.h"
 #include "PluginEditor.h"
+#include "RealtimeAllocationCheck.h"
 
-#define MAX_DELAY_LENGTH 5
+#define MAX_DELAY_LENGTH 300 //seconds; the line is only as long as the delay in use, see prepareToPlay
+#define DELAY_HEADROOM_SECONDS 1.0 //allocated past the delay in use, so small increases don't need a new line
 #define MAX_FEEDBACK 0.99f
+#define FEEDBACK_RAMP_SECONDS 0.02
+#define DELAY_CROSSFADE_SECONDS 0.05
+#define DEFAULT_NUM_TAPS 4
+#define SUBBLOCK_MIN_SAMPLES 32 //MIDI events closer together than this are applied at the same split
+#define DEFAULT_CHUNK_SAMPLES 512 //16 channels of a chunk plus its send copy fit in 64 KB
+#define MAX_CHUNK_SAMPLES 8192
+#define OFFLINE_CHUNK_SAMPLES 4096 //offline renders are cut into longer chunks, so each handoff to the render threads carries more work
+#define OFFLINE_PARALLEL_MIN_SAMPLES 256 //shorter chunks (cut short by MIDI events) aren't worth waking the render threads for
+#define REALTIME_PARALLEL_MIN_CHANNELS 16 //narrower buses are cheap enough to run on the host's audio thread alone
+#define REALTIME_CHANNELS_PER_THREAD 4 //a wide bus gets at most one thread per this many channels
+#define REALTIME_PARALLEL_MIN_SAMPLES 256 //shorter chunks cost less than handing them to the workers
+#define GROUPS_PER_THREAD 2 //a few more tasks than threads, so one that starts late has work left to steal
+#define MAX_CHANNEL_GROUPS 32
+#define TAP_TEMPO_MIN_SECONDS 0.06
+#define TAP_TEMPO_MAX_SECONDS 3.0 //a longer gap starts a new run of taps
+#define SILENCE_THRESHOLD 3.0e-5f //about -90 dBFS: input below this counts as silence, and tails are measured down to it
+#define RT60_TO_SILENCE 1.5 //-90 dB takes one and a half times as long as -60 dB
+#define PARAMETER_NOTIFY_HZ 30 //how often parameters changed by MIDI are passed on to the host
+#define FIRST_MAPPED_CONTROLLER 20 //CCs 20-25 (undefined in the MIDI spec) control the main parameters by default
+#define STATE_MAX_TAIL_SECONDS 20.0 //a saved tail covers the longest delay in use, up to this
+#define STATE_TAIL_ATTEMPTS 3
+
+namespace
+{
+    //factory programs, selectable from the host or by MIDI program change
+    struct Program
+    {
+        const char* name;
+        MyGreatProjectAudioProcessor::Mode mode;
+        float length, feedback, tone, drive, rt60;
+    };
+
+    const Program programs[] = {
+        { "Init",           MyGreatProjectAudioProcessor::Mode::delay,    1.0f,   0.5f,  FeedbackCharacter::maxToneHz, 0.0f, 2.0f },
+        { "Slapback",       MyGreatProjectAudioProcessor::Mode::delay,    0.09f,  0.4f,  8000.0f,                      3.0f, 2.0f },
+        { "Tape echo",      MyGreatProjectAudioProcessor::Mode::delay,    0.375f, 0.65f, 3500.0f,                      9.0f, 2.0f },
+        { "Ping-pong taps", MyGreatProjectAudioProcessor::Mode::multiTap, 1.0f,   0.5f,  FeedbackCharacter::maxToneHz, 0.0f, 2.0f },
+        { "Hall",           MyGreatProjectAudioProcessor::Mode::reverb,   1.0f,   0.35f, FeedbackCharacter::maxToneHz, 0.0f, 2.5f },
+    };
+
+    constexpr int numPrograms = static_cast<int>(sizeof(programs) / sizeof(programs[0]));
+
+    //the tags saved states refer to parameters by (see PluginState): add new ones at the end, never renumber
+    const std::pair<uint8_t, const char*> stateParameterTags[] = {
+        { 1, ParameterIDs::feedback }, { 2, ParameterIDs::length }, { 3, ParameterIDs::mode },  { 4, ParameterIDs::rt60 },
+        { 5, ParameterIDs::fdnSize },  { 6, ParameterIDs::tone },   { 7, ParameterIDs::drive }, { 8, ParameterIDs::antialiasing },
+        { 9, ParameterIDs::grainSize }, { 10, ParameterIDs::grainDensity }, { 11, ParameterIDs::grainSpray },
+        { 12, ParameterIDs::grainPitch }, { 13, ParameterIDs::grainReverse }, { 14, ParameterIDs::shimmer },
+    };
+
+    const char* getStateParameterID(uint8_t tag) {
+        for (const auto& [t, id] : stateParameterTags)
+            if (t == tag) return id;
+        return nullptr;
+    }
+
+    //how many more times a signal fed back at this gain goes round before it's below SILENCE_THRESHOLD
+    double passesToSilence(float gain) {
+        return gain > 0.0f ? std::ceil(std::log(SILENCE_THRESHOLD) / std::log(gain)) : 0.0;
+    }
+}
 
 //==============================================================================
 MyGreatProjectAudioProcessor::MyGreatProjectAudioProcessor()
@@ -24,16 +87,55 @@ MyGreatProjectAudioProcessor::MyGreatProjectAudioProcessor()
                       #endif
                        .withOutput ("Output", juce::AudioChannelSet::stereo(), true)
                      #endif
-                       )
+                       ),
+#else
+     :
 #endif
+       parameters(*this, nullptr, "PARAMETERS", createParameterLayout())
 {
-    runTests();
+    feedbackParameter = parameters.getRawParameterValue(ParameterIDs::feedback);
+    lengthParameter = parameters.getRawParameterValue(ParameterIDs::length);
+    modeParameter = parameters.getRawParameterValue(ParameterIDs::mode);
+    rt60Parameter = parameters.getRawParameterValue(ParameterIDs::rt60);
+    fdnSizeParameter = parameters.getRawParameterValue(ParameterIDs::fdnSize);
+    toneParameter = parameters.getRawParameterValue(ParameterIDs::tone);
+    driveParameter = parameters.getRawParameterValue(ParameterIDs::drive);
+    antialiasingParameter = parameters.getRawParameterValue(ParameterIDs::antialiasing);
+    grainSizeParameter = parameters.getRawParameterValue(ParameterIDs::grainSize);
+    grainDensityParameter = parameters.getRawParameterValue(ParameterIDs::grainDensity);
+    grainSprayParameter = parameters.getRawParameterValue(ParameterIDs::grainSpray);
+    grainPitchParameter = parameters.getRawParameterValue(ParameterIDs::grainPitch);
+    grainReverseParameter = parameters.getRawParameterValue(ParameterIDs::grainReverse);
+    shimmerParameter = parameters.getRawParameterValue(ParameterIDs::shimmer);
+    programParameters = { parameters.getParameter(ParameterIDs::mode), parameters.getParameter(ParameterIDs::length),
+                          parameters.getParameter(ParameterIDs::feedback), parameters.getParameter(ParameterIDs::tone),
+                          parameters.getParameter(ParameterIDs::drive), parameters.getParameter(ParameterIDs::rt60) };
+    const char* mappedParameters[] = { ParameterIDs::feedback, ParameterIDs::length, ParameterIDs::tone,
+                                       ParameterIDs::drive, ParameterIDs::mode, ParameterIDs::rt60 };
+    for (int i = 0; i < 6; ++i)
+        setControllerMapping(FIRST_MAPPED_CONTROLLER + i, mappedParameters[i]);
+    for (const auto& [tag, id] : stateParameterTags) {
+        jassert(numAudioThreadParameters < static_cast<int>(audioThreadParameters.size()));
+        auto& entry = audioThreadParameters[static_cast<size_t>(numAudioThreadParameters++)];
+        entry.parameter = parameters.getParameter(id);
+        entry.value = parameters.getRawParameterValue(id);
+    }
+    //a dotted pattern that ping-pongs and fades out, so multi-tap mode does something out of the box
+    for (int i = 0; i < DelayLine::maxTaps; ++i)
+        setTap(i, 0.25f * static_cast<float>(i + 1), std::pow(0.7f, static_cast<float>(i)), (i % 2 == 0 ? -0.6f : 0.6f));
+    setNumTaps(DEFAULT_NUM_TAPS);
+    setChunkSize(DEFAULT_CHUNK_SAMPLES);
+    chunkSamples = getChunkSize();
+    startTimerHz(PARAMETER_NOTIFY_HZ); //passes parameter changes made by MIDI on to the host
+    //no DSP work here: hosts construct and destroy instances constantly while scanning and loading
+    //sessions. the delay line is allocated in prepareToPlay, and runTests() is only run on request
 }
 
 
 MyGreatProjectAudioProcessor::~MyGreatProjectAudioProcessor()
 {
     output = false; //on destroy, mute
+    stopTimer();
 }
 
 //==============================================================================
@@ -71,27 +173,45 @@ bool MyGreatProjectAudioProcessor::isMidiEffect() const
 
 double MyGreatProjectAudioProcessor::getTailLengthSeconds() const
 {
-    return MAX_DELAY_LENGTH;
+    //how long output continues after the input stops, down to SILENCE_THRESHOLD. the delay and the taps only
+    //write the input into the line (nothing recirculates), so an echo lasts one delay; the network rings on, and
+    //so do grains fed back by the shimmer, one pass of the longest grain at a time
+    const float wet = getDelayFeedback();
+    if (wet < SILENCE_THRESHOLD)
+        return 0.0;
+    switch (static_cast<Mode>(static_cast<int>(modeParameter->load(std::memory_order_relaxed)))) {
+        case Mode::reverb:   return RT60_TO_SILENCE * rt60Parameter->load(std::memory_order_relaxed);
+        case Mode::multiTap: return getLongestDelaySeconds();
+        case Mode::granular: return getLongestDelaySeconds() * (1.0 + passesToSilence(shimmerParameter->load(std::memory_order_relaxed)));
+        case Mode::delay:
+        default:             return getDelayLength();
+    }
 }
 
 int MyGreatProjectAudioProcessor::getNumPrograms()
 {
-    return 1;   // NB: some hosts don't cope very well if you tell them there are 0 programs,
-                // so this should be at least 1, even if you're not really implementing programs.
+    return numPrograms;
 }
 
 int MyGreatProjectAudioProcessor::getCurrentProgram()
 {
-    return 0;
+    return currentProgram.load(std::memory_order_relaxed);
 }
 
 void MyGreatProjectAudioProcessor::setCurrentProgram (int index)
 {
+    //called by the host on the message thread. a MIDI program change goes through handleMidiEvent instead
+    if (index < 0 || index >= numPrograms) return;
+    currentProgram.store(index, std::memory_order_relaxed);
+    const auto& program = programs[index];
+    const float values[] = { static_cast<float>(program.mode), program.length, program.feedback, program.tone, program.drive, program.rt60 };
+    for (size_t i = 0; i < programParameters.size(); ++i)
+        programParameters[i]->setValueNotifyingHost(programParameters[i]->convertTo0to1(values[i]));
 }
 
 const juce::String MyGreatProjectAudioProcessor::getProgramName (int index)
 {
-    return {};
+    return (index >= 0 && index < numPrograms) ? juce::String(programs[index].name) : juce::String();
 }
 
 void MyGreatProjectAudioProcessor::changeProgramName (int index, const juce::String& newName)
@@ -101,24 +221,135 @@ void MyGreatProjectAudioProcessor::changeProgramName (int index, const juce::Str
 //==============================================================================
 void MyGreatProjectAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
+    RealtimeAllocationCheck::install();
+    std::lock_guard<std::mutex> guard(stateLock);
     auto sampleRateInt = static_cast<unsigned long>(std::ceil(sampleRate));
-    //Check if buffer needs to be reallocated | treating buffer_left and right as the same in this case
-    unsigned long bufferLength = MAX_DELAY_LENGTH * sampleRateInt;
-    buffer_left = std::vector(bufferLength, 0.0f);
-    buffer_right = std::vector(bufferLength, 0.0f);
-    block_vector = std::vector(samplesPerBlock, 0.0f);
-    block_vector_2 = std::vector(samplesPerBlock, 0.0f);
+    //one line per channel of the main bus, sized for the delay in use plus some headroom; capacity gets rounded up to a
+    //power of two. a longer delay later on is grown by the resizer off the audio thread. hosts call this on every
+    //transport/bypass/device change, so the line keeps its storage and contents unless it has to change
+    const int numChannels = std::max(getTotalNumInputChannels(), getTotalNumOutputChannels());
+    const bool rateChanged = currentSampleRate > 0.0 && sampleRate != currentSampleRate;
+    const SampleFormat format = getStorageFormat();
+    double bufferLength = (getLongestDelaySeconds() + DELAY_HEADROOM_SECONDS) * sampleRate;
+    if (delayLine.getCapacity() > 0) //never shrink: that would clear the line
+        bufferLength = std::max(bufferLength, (delayLine.getCapacity() - 1) * (rateChanged ? sampleRate / currentSampleRate : 1.0));
+    resizer.reset(); //a half-built line was sized for the old layout
+    resizer.start();
+    if (rateChanged && resampleOnRateChange)
+        delayLine.setSizeAndResample(numChannels, static_cast<int>(bufferLength), sampleRate / currentSampleRate, format);
+    else {
+        delayLine.setSize(numChannels, static_cast<int>(bufferLength), format);
+        if (rateChanged) delayLine.clear(); //old echoes would play back at the wrong pitch
+    }
+    if (!pendingTail.isEmpty()) {
+        //a session restored before the host prepared us: the saved tail goes in now, at this rate
+        const auto tail = pendingTail.resampled(sampleRate);
+        std::vector<const float*> history;
+        for (int ch = 0; ch < tail.numChannels; ++ch)
+            history.push_back(tail.getChannel(ch));
+        delayLine.writeHistory(history.data(), tail.numChannels, tail.length);
+        pendingTail = {};
+    }
+    resizer.blockFinished(delayLine); //what readHistory may copy until the first block says otherwise
+    prepared = true;
+    //the reverb's lines are allocated here only if reverb mode is selected already; otherwise the audio thread has
+    //reverbResizer allocate them the first time it is
+    reverbResizer.reset();
+    reverbResizer.start();
+    reverb.prepare(sampleRate);
+    if (static_cast<Mode>(static_cast<int>(modeParameter->load(std::memory_order_relaxed))) == Mode::reverb)
+        reverb.allocate();
+    grains.prepare(numChannels);
+    //a few channel groups per thread an offline render, or a wide bus in realtime, can use (one group if there's a
+    //single core), each a contiguous run of channels. other realtime blocks go through all of them at once
+    if (enhanceOfflineRender)
+        renderPool->start();
+    const int cores = static_cast<int>(std::thread::hardware_concurrency());
+    const bool wideBus = splitWideBuses && numChannels >= REALTIME_PARALLEL_MIN_CHANNELS;
+    realtimePool.start(wideBus ? std::min(cores, numChannels / REALTIME_CHANNELS_PER_THREAD) - 1 : 0);
+    const int numThreads = std::max(renderPool->getNumWorkers(), realtimePool.getNumWorkers()) + 1;
+    const int numGroups = numThreads > 1 ? std::clamp(std::min(numChannels, numThreads * GROUPS_PER_THREAD), 1, MAX_CHANNEL_GROUPS) : 1;
+    channelGroups.resize(static_cast<size_t>(numGroups));
+    for (int g = 0; g < numGroups; ++g) {
+        auto& group = channelGroups[static_cast<size_t>(g)];
+        group.firstChannel = numChannels * g / numGroups;
+        group.numChannels = numChannels * (g + 1) / numGroups - group.firstChannel;
+        group.character.prepare(sampleRate, group.numChannels);
+    }
+    //the host's samplesPerBlock is only a hint: blocks can be longer (offline render, freewheeling) or vary, so
+    //nothing is sized from it. processBlock cuts every block into chunks, and the send buffer holds one chunk
+    //(an offline one, which can be longer)
+    chunkSamples = getChunkSize();
+    sendBuffer.setSize(numChannels, std::max(chunkSamples, OFFLINE_CHUNK_SAMPLES));
+    sendChannels = sendBuffer.getArrayOfWritePointers();
+    currentSampleRate = sampleRate;
+    silentSamples = 0; //the line may have been resampled or resized: start counting again
+    profiler.reset(); //the budget per block has changed
+    renderingOffline = enhanceOfflineRender && isNonRealtime(); //hosts usually switch before preparing for a render
+    updateCharacter();
+    feedbackSmoother.reset(sampleRate, FEEDBACK_RAMP_SECONDS);
+    feedbackSmoother.setCurrentAndTarget(getDelayFeedback());
+    delayFade.reset(sampleRate, DELAY_CROSSFADE_SECONDS);
     refreshDelayLen(sampleRateInt);
 }
 
 void MyGreatProjectAudioProcessor::refreshDelayLen(unsigned long sampleRate) {
-    delayLengthSmp = sampleRate * length;
+    delayLengthSmp = static_cast<unsigned long>(sampleRate * getDelayLength());
+    fadingFromDelaySmp = static_cast<int>(delayLengthSmp);
+    delayFade.setCurrentAndTarget(1.0f);
+}
+
+int MyGreatProjectAudioProcessor::getTargetDelaySamples() const noexcept {
+    //the oversampled colour stage delays what goes into the line, so the read head comes forward to match. a delay
+    //shorter than that latency can't be compensated and stays at one sample
+    return std::max(1, static_cast<int>(lengthParameter->load(std::memory_order_relaxed) * currentSampleRate) - getCharacter().getLatencySamples());
+}
+
+float MyGreatProjectAudioProcessor::getLongestDelaySeconds() const noexcept {
+    float longest = getDelayLength();
+    const int tapCount = numTaps.load(std::memory_order_relaxed);
+    for (int t = 0; t < tapCount; ++t)
+        longest = std::max(longest, tapSettings[static_cast<size_t>(t)].seconds.load(std::memory_order_relaxed));
+    //grains reach past the delay by their spray and what they fall behind over their length. before the first
+    //prepareToPlay that's measured at a typical rate; the few samples of difference are well within the headroom
+    if (static_cast<Mode>(static_cast<int>(modeParameter->load(std::memory_order_relaxed))) == Mode::granular) {
+        const double sampleRate = currentSampleRate > 0.0 ? currentSampleRate : 48000.0;
+        longest = std::max(longest, static_cast<float>(GranularDelay::getReach(getGrainSettings(sampleRate)) / sampleRate));
+    }
+    return longest;
+}
+
+GranularDelay::Settings MyGreatProjectAudioProcessor::getGrainSettings(double sampleRate) const noexcept {
+    GranularDelay::Settings settings;
+    const auto rate = static_cast<float>(sampleRate);
+    settings.delaySamples = lengthParameter->load(std::memory_order_relaxed) * rate;
+    settings.grainSamples = grainSizeParameter->load(std::memory_order_relaxed) * 0.001f * rate;
+    settings.grainsPerSample = grainDensityParameter->load(std::memory_order_relaxed) / rate;
+    settings.spraySamples = grainSprayParameter->load(std::memory_order_relaxed) * 0.001f * rate;
+    settings.rate = std::exp2(grainPitchParameter->load(std::memory_order_relaxed) / 12.0f);
+    settings.reverseProbability = grainReverseParameter->load(std::memory_order_relaxed);
+    settings.shimmer = shimmerParameter->load(std::memory_order_relaxed);
+    return settings;
+}
+
+int MyGreatProjectAudioProcessor::reserveDelay(int delaySamples) noexcept {
+    //the line can't hold this delay yet: ask for a bigger one and use the longest we have until it's swapped in
+    if (delaySamples < delayLine.getCapacity())
+        return std::max(1, delaySamples);
+    resizer.request(delayLine, delaySamples + static_cast<int>(DELAY_HEADROOM_SECONDS * currentSampleRate));
+    return delayLine.clampDelay(delaySamples);
 }
 
 void MyGreatProjectAudioProcessor::releaseResources()
 {
-    buffer_left.resize(0);
-    buffer_right.resize(0);
+    //VST3 and AU hosts call this before every re-prepare (bypass, transport, rate changes), so the lines and their
+    //contents are kept for prepareToPlay to pick up again. their storage goes back to the pool when the layout
+    //changes or the instance is destroyed. only work in flight is dropped, and the worker threads stop
+    std::lock_guard<std::mutex> guard(stateLock);
+    prepared = false;
+    resizer.reset();
+    reverbResizer.reset();
+    realtimePool.stop();
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -128,12 +359,9 @@ bool MyGreatProjectAudioProcessor::isBusesLayoutSupported (const BusesLayout& la
     juce::ignoreUnused (layouts);
     return true;
   #else
-    // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
-    // Some plugin hosts, such as certain GarageBand versions, will only
-    // load plugins that support stereo bus layouts.
-    if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono()
-     && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
+    // Any discrete layout works (mono, stereo, surround, ambisonics...): every channel
+    // gets its own line, so we only need a main output to exist.
+    if (layouts.getMainOutputChannelSet().isDisabled())
         return false;
 
     // This checks if the input layout matches the output layout
@@ -150,7 +378,27 @@ bool MyGreatProjectAudioProcessor::isBusesLayoutSupported (const BusesLayout& la
 
 void MyGreatProjectAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
+    processBlockImpl(buffer, midiMessages);
+}
+
+void MyGreatProjectAudioProcessor::processBlock (juce::AudioBuffer<double>& buffer, juce::MidiBuffer& midiMessages)
+{
+    processBlockImpl(buffer, midiMessages);
+}
+
+bool MyGreatProjectAudioProcessor::supportsDoublePrecisionProcessing() const
+{
+    //a 64-bit host's buffers go straight through the engine instead of being converted to float and back.
+    //the line still stores floats (or a 16-bit format): the dry path and the mixing stay in double
+    return true;
+}
+
+template <typename SampleType>
+void MyGreatProjectAudioProcessor::processBlockImpl(juce::AudioBuffer<SampleType>& buffer, juce::MidiBuffer& midiMessages)
+{
+    DspLoadProfiler::ScopedBlock profileBlock(profiler, buffer.getNumSamples(), currentSampleRate);
     juce::ScopedNoDenormals noDenormals;
+    RealtimeAllocationCheck::ScopedRealtimeSection realtimeSection;
     auto totalNumInputChannels  = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
 
@@ -163,48 +411,386 @@ void MyGreatProjectAudioProcessor::processBlock (juce::AudioBuffer<float>& buffe
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear (i, 0, buffer.getNumSamples());
 
-    // This is the place where you'd normally do the guts of your plugin's
-    // audio processing...
-    // Make sure to reset the state if your inner loop is processing
-    // the samples and the outer loop is handling the channels.
-    // Alternatively, you can process the samples with the channels
-    // interleaved by keeping the same state.
-    for (int channel = 0; channel < 2; ++channel) //TODO take out forced stereo
-    {
-        float* channelData = buffer.getWritePointer (channel);
-        const char side = (channel == 0 ? 'l' : 'r');
-        const int samples = buffer.getNumSamples();
-        float delayOut[samples];
-        pushToBuffer(channelData, delayOut, samples, side);
-        for (const float f : delayOut) {
-            *channelData += f;
-            channelData++;
+    const int numChannels = std::min(totalNumInputChannels, buffer.getNumChannels());
+    const int numSamples = buffer.getNumSamples();
+    SampleType* const* channels = buffer.getArrayOfWritePointers();
+    //checked every block, so the cheap realtime path is back as soon as the host stops rendering offline
+    renderingOffline = enhanceOfflineRender && isNonRealtime();
+    const int chunkLimit = renderingOffline ? sendBuffer.getNumSamples() : chunkSamples;
+    //a grown or restored line only swaps pointers here; the allocation happened on the resizer thread. a restored
+    //tail has to be heard, so the silence count starts over
+    if (resizer.swapIfReady(delayLine))
+        silentSamples = 0;
+    //the reverb's lines are only held while reverb mode is selected: allocated when it is, freed when it's left. until
+    //they're swapped in the reverb is silent and the dry signal passes through
+    reverbResizer.swapIfReady(reverb.getLines());
+    const bool reverbSelected = static_cast<Mode>(static_cast<int>(modeParameter->load(std::memory_order_relaxed))) == Mode::reverb;
+    if (reverbSelected != reverb.isAllocated())
+        reverbResizer.requestLayout(reverb.getLines(), reverbSelected ? FeedbackDelayNetwork::maxLines : 0, reverb.getLongestLine());
+
+    float inputPeak = 0.0f;
+    for (int ch = 0; ch < numChannels; ++ch)
+        inputPeak = std::max(inputPeak, static_cast<float>(buffer.getMagnitude(ch, 0, numSamples)));
+
+    //only measured while an editor is listening
+    const bool publishTelemetry = telemetry.isConsumerActive();
+    TelemetryFrame frame;
+    const DelayLine& scopedLine = reverbSelected ? reverb.getLines() : delayLine; //the line the scope shows
+    const int64_t lineWritesBefore = scopedLine.getWriteCount();
+    if (publishTelemetry) {
+        frame.blockSeconds = static_cast<float>(numSamples / currentSampleRate);
+        frame.inputPeak = inputPeak;
+    }
+
+    auto event = midiMessages.begin();
+    const auto lastEvent = midiMessages.end();
+    if (isIdle(inputPeak, numSamples)) {
+        //the input is silent and so is everything still to come out of the engine: the block passes through
+        //untouched. MIDI is still handled, so parameters are up to date when the input comes back
+        for (; event != lastEvent; ++event)
+            handleMidiEvent((*event).getMessage(), samplesProcessed + std::min((*event).samplePosition, numSamples));
+    }
+    else {
+        //split the block at MIDI events so CCs, tap tempo and program changes land on their own sample whatever
+        //the host's buffer size, and into chunks of at most chunkLimit so any block length works without
+        //reallocating. events due within SUBBLOCK_MIN_SAMPLES of a split are applied together at it, so dense
+        //controller streams still leave the kernels runs of at least that many samples. the time passed along is the
+        //event's own, so tap tempo measures intervals to the sample whichever split the event is applied at
+        for (int start = 0; start < numSamples;) {
+            for (; event != lastEvent && (*event).samplePosition < start + SUBBLOCK_MIN_SAMPLES; ++event)
+                handleMidiEvent((*event).getMessage(), samplesProcessed + std::max(start, (*event).samplePosition));
+            const int end = std::min(start + chunkLimit, event != lastEvent ? std::min(numSamples, (*event).samplePosition) : numSamples);
+            processSubBlock(channels, numChannels, start, end - start);
+            start = end;
         }
+        for (; event != lastEvent; ++event) //events past the end of the block, which hosts shouldn't send
+            handleMidiEvent((*event).getMessage(), samplesProcessed + numSamples);
     }
+
+    samplesProcessed += numSamples;
+    resizer.blockFinished(delayLine);
     if (!output) buffer.applyGain(0.0); //mute if we failed any tests
+
+    if (publishTelemetry) {
+        for (int ch = 0; ch < numChannels; ++ch)
+            frame.outputPeak = std::max(frame.outputPeak, static_cast<float>(buffer.getMagnitude(ch, 0, numSamples)));
+        //a line cleared or swapped during the block rewinds its count: nothing is measured then
+        const auto written = static_cast<int>(std::clamp<int64_t>(scopedLine.getWriteCount() - lineWritesBefore, 0,
+                                                                  std::max(0, scopedLine.getCapacity() - 1)));
+        frame.linePeak = scopedLine.getPeak(scopedLine.getWriteCount() - written, written);
+        frame.feedback = feedbackSmoother.getCurrentValue();
+        frame.delaySeconds = static_cast<float>(static_cast<double>(delayLengthSmp) / currentSampleRate);
+        frame.mode = static_cast<int>(modeParameter->load(std::memory_order_relaxed));
+        frame.memoryBytes = getMemoryUsage();
+        telemetry.push(frame);
+    }
 }
 
-//push to a delay line. side is 'l' or 'r'. takes feedback % into account by summing the discarded block with the end of the delay line. returns a block of equal length that was ejected from the array.
-void MyGreatProjectAudioProcessor::pushToBuffer(const float *sampleBlock, float* blockOut, int blockLength,
-                                                  const char side) {
-    block_vector.clear(); //block_vector stores the audio we're popping in, modified by feedback
-    std::vector<float>& toPush = (side == 'l' ? buffer_left : buffer_right);
-    const float *sampleBlockIter = sampleBlock;
-    for (int i = 0; i<blockLength; i++) {
-        //insert popped samples into blockOut, before we actually pop them
-        *blockOut = toPush[i];
-        blockOut++;
+bool MyGreatProjectAudioProcessor::isIdle(float inputPeak, int numSamples) noexcept {
+    //counts how long the input has been silent, and calls the engine idle once that's longer than anything it
+    //could still put out. for the delay and the taps that's the whole line rather than just the tail, so every
+    //sample in it is silent and a longer delay set while idle can't reach back to older audio. the first block
+    //with input in it is processed as usual
+    const int mode = static_cast<int>(modeParameter->load(std::memory_order_relaxed));
+    if (inputPeak >= SILENCE_THRESHOLD || mode != silentMode) {
+        silentSamples = 0;
+        silentMode = mode;
     }
-    toPush.erase(toPush.begin(), toPush.begin() + blockLength); //take the beginning of the buffer out
-    using namespace juce;
-    FloatVectorOperations::multiply(block_vector.data(), sampleBlock, feedback, blockLength);
-    assert(blockLength <= toPush.size());
-    for (int j = 0; j<blockLength; j++) { //insert our feedback-modified sample block
-        //instead of pushing to the back of the vector, we'll push at delay_length - block length
-        toPush.insert(toPush.begin() + (delayLengthSmp - blockLength + j), block_vector[j]); // NOLINT(*-narrowing-conversions)
+    const int64_t silentBefore = silentSamples;
+    silentSamples += numSamples;
+
+    int64_t window = static_cast<int64_t>(delayLine.getCapacity());
+    if (static_cast<Mode>(mode) == Mode::reverb)
+        window = static_cast<int64_t>(RT60_TO_SILENCE * rt60Parameter->load(std::memory_order_relaxed) * currentSampleRate);
+    else if (static_cast<Mode>(mode) == Mode::granular) //the shimmer keeps the line going for a while after the input
+        window *= static_cast<int64_t>(1.0 + passesToSilence(shimmerParameter->load(std::memory_order_relaxed)));
+    return inputPeak < SILENCE_THRESHOLD && silentBefore >= window;
+}
+
+template <typename SampleType>
+void MyGreatProjectAudioProcessor::processSubBlock(SampleType* const* channels, int numChannels, int startSample, int numSamples) {
+    //parameters are picked up again for every sub-block, so a change made by a MIDI event applies from its split on
+    feedbackSmoother.setTarget(feedbackParameter->load(std::memory_order_relaxed));
+    updateCharacter();
+    switch (static_cast<Mode>(static_cast<int>(modeParameter->load(std::memory_order_relaxed)))) {
+        case Mode::multiTap: {
+            DspLoadProfiler::ScopedSpan span(profiler, "multiTap", numSamples);
+            processMultiTap(channels, numChannels, startSample, numSamples);
+            break;
+        }
+        case Mode::reverb: {
+            DspLoadProfiler::ScopedSpan span(profiler, "reverb", numSamples);
+            processReverb(channels, numChannels, startSample, numSamples);
+            break;
+        }
+        case Mode::granular: {
+            DspLoadProfiler::ScopedSpan span(profiler, "granular", numSamples);
+            processGranular(channels, numChannels, startSample, numSamples);
+            break;
+        }
+        case Mode::delay:
+        default: {
+            DspLoadProfiler::ScopedSpan span(profiler, "delay", numSamples);
+            processDelay(channels, numChannels, startSample, numSamples);
+            break;
+        }
+    }
+}
+
+void MyGreatProjectAudioProcessor::handleMidiEvent(const juce::MidiMessage& message, int64_t time) {
+    if (message.isController()) {
+        auto* parameter = controllerMap[static_cast<size_t>(message.getControllerNumber() & 127)].load(std::memory_order_relaxed);
+        if (parameter != nullptr)
+            setParameterFromAudioThread(parameter, static_cast<float>(message.getControllerValue()) / 127.0f);
+    } else if (message.isNoteOn()) {
+        tapTempo(time);
+    } else if (message.isProgramChange()) {
+        const int index = message.getProgramChangeNumber();
+        if (index >= numPrograms) return;
+        currentProgram.store(index, std::memory_order_relaxed);
+        const auto& program = programs[index];
+        const float values[] = { static_cast<float>(program.mode), program.length, program.feedback, program.tone, program.drive, program.rt60 };
+        for (size_t i = 0; i < programParameters.size(); ++i)
+            setParameterFromAudioThread(programParameters[i], programParameters[i]->convertTo0to1(values[i]));
+    }
+}
+
+//setValueNotifyingHost can block or allocate in the host, so the audio thread only writes the value the DSP reads
+//(from the next sub-block on) and flags the parameter. posting a message could block or allocate too, so nothing is
+//posted: timerCallback picks the flags up on the message thread
+void MyGreatProjectAudioProcessor::setParameterFromAudioThread(juce::RangedAudioParameter* parameter, float normalisedValue) noexcept {
+    for (int i = 0; i < numAudioThreadParameters; ++i) {
+        auto& entry = audioThreadParameters[static_cast<size_t>(i)];
+        if (entry.parameter != parameter)
+            continue;
+        normalisedValue = std::clamp(normalisedValue, 0.0f, 1.0f);
+        entry.value->store(parameter->convertFrom0to1(normalisedValue), std::memory_order_relaxed);
+        entry.normalisedValue.store(normalisedValue, std::memory_order_relaxed);
+        parametersToNotify.fetch_or(1u << i, std::memory_order_release);
+        return;
+    }
+}
+
+void MyGreatProjectAudioProcessor::timerCallback() {
+    //the flags are taken before the values are read, so a change made meanwhile flags its parameter again
+    if (parametersToNotify.load(std::memory_order_relaxed) == 0)
+        return;
+    const uint32_t changed = parametersToNotify.exchange(0, std::memory_order_acquire);
+    for (int i = 0; i < numAudioThreadParameters; ++i)
+        if (changed & (1u << i)) {
+            auto& entry = audioThreadParameters[static_cast<size_t>(i)];
+            entry.parameter->setValueNotifyingHost(entry.normalisedValue.load(std::memory_order_relaxed));
+        }
+}
+
+void MyGreatProjectAudioProcessor::tapTempo(int64_t time) {
+    //every note-on is a tap: the delay follows the average of the last few intervals.
+    //a gap outside the tap range starts a new run rather than setting an absurd delay
+    const double interval = static_cast<double>(time - lastTapTime) / currentSampleRate;
+    lastTapTime = time;
+    if (interval < TAP_TEMPO_MIN_SECONDS || interval > TAP_TEMPO_MAX_SECONDS) {
+        numTapIntervals = 0;
+        return;
+    }
+
+    tapIntervals[static_cast<size_t>(numTapIntervals % static_cast<int>(tapIntervals.size()))] = interval;
+    ++numTapIntervals;
+    const int count = std::min(numTapIntervals, static_cast<int>(tapIntervals.size()));
+    double sum = 0.0;
+    for (int i = 0; i < count; ++i)
+        sum += tapIntervals[static_cast<size_t>(i)];
+
+    auto* length = programParameters[1];
+    setParameterFromAudioThread(length, length->convertTo0to1(static_cast<float>(sum / count)));
+}
+
+void MyGreatProjectAudioProcessor::setControllerMapping(int controllerNumber, const juce::String& parameterID) {
+    if (controllerNumber < 0 || controllerNumber > 127) return;
+    controllerMap[static_cast<size_t>(controllerNumber)].store(parameterID.isEmpty() ? nullptr : parameters.getParameter(parameterID));
+}
+
+template <typename SampleType>
+void MyGreatProjectAudioProcessor::processDelay(SampleType* const* channels, int numChannels, int startSample, int numSamples) {
+    //a new delay time crossfades between the old and new read positions; a change
+    //that arrives mid-fade waits for the current fade to finish
+    const int targetDelay = reserveDelay(getTargetDelaySamples());
+    if (!delayFade.isSmoothing() && targetDelay != static_cast<int>(delayLengthSmp)) {
+        fadingFromDelaySmp = static_cast<int>(delayLengthSmp);
+        delayLengthSmp = static_cast<unsigned long>(targetDelay);
+        delayFade.setCurrentAndTarget(0.0f);
+        delayFade.setTarget(1.0f);
+    }
+
+    //one pass per channel: mixes the echo into the host buffer and feeds the dry (or coloured) input to the line.
+    //the block is only split where a ramp ends, or where the send buffer is full, so the kernels see a constant slope.
+    //every batch of groups runs the same ramps on its own copies; the first batch's end state is kept
+    const bool colour = getCharacter().isActive();
+    const int end = startSample + numSamples;
+    const int maxLength = colour ? sendBuffer.getNumSamples() : numSamples;
+    const int fromDelay = fadingFromDelaySmp, toDelay = static_cast<int>(delayLengthSmp);
+    SmoothedParameter feedbackAfter, fadeAfter;
+    processChannelGroups(numSamples, [&] (int firstGroup, int numGroups) {
+        SmoothedParameter feedback = feedbackSmoother, fade = delayFade;
+        const auto range = getChannelRange(firstGroup, numGroups, numChannels);
+        SampleType* const* block = channels + range.getFirstChannel();
+        for (int start = startSample; start < end;) {
+            const int length = fade.getNumSamplesAtCurrentStep(feedback.getNumSamplesAtCurrentStep(std::min(maxLength, end - start)));
+            const float* const* send = colour ? colourSend(firstGroup, numGroups, numChannels, channels, start, length) : nullptr;
+            if (fade.isSmoothing())
+                range.processInPlaceCrossfading(block, start, length, fromDelay, toDelay, fade.getCurrentValue(), fade.getStep(),
+                                                feedback.getCurrentValue(), feedback.getStep(), send);
+            else
+                range.processInPlace(block, start, length, toDelay, feedback.getCurrentValue(), feedback.getStep(), send);
+            feedback.skip(length);
+            fade.skip(length);
+            start += length;
+        }
+        if (firstGroup == 0) {
+            feedbackAfter = feedback;
+            fadeAfter = fade;
+        }
+    });
+    feedbackSmoother = feedbackAfter;
+    delayFade = fadeAfter;
+}
+
+template <typename SampleType>
+void MyGreatProjectAudioProcessor::processMultiTap(SampleType* const* channels, int numChannels, int startSample, int numSamples) {
+    //snapshot the taps once per block: seconds to samples, pan to equal-power gains
+    const int tapCount = numTaps.load(std::memory_order_relaxed);
+    const bool stereo = (numChannels == 2);
+    const int latency = getCharacter().getLatencySamples();
+    int longestTap = 0;
+    for (int t = 0; t < tapCount; ++t) {
+        const auto& settings = tapSettings[static_cast<size_t>(t)];
+        auto& tap = activeTaps[static_cast<size_t>(t)];
+        const float gain = settings.gain.load(std::memory_order_relaxed);
+        const float angle = (settings.pan.load(std::memory_order_relaxed) + 1.0f) * juce::MathConstants<float>::pi * 0.25f;
+        tap.delaySamples = std::max(1, static_cast<int>(settings.seconds.load(std::memory_order_relaxed) * currentSampleRate) - latency);
+        tap.gains[0] = stereo ? gain * std::cos(angle) : gain;
+        tap.gains[1] = stereo ? gain * std::sin(angle) : gain;
+        longestTap = std::max(longestTap, tap.delaySamples);
+    }
+    reserveDelay(longestTap); //taps past the capacity are clamped by the kernel until the line has grown
+
+    const bool colour = getCharacter().isActive();
+    const int end = startSample + numSamples;
+    const int maxLength = colour ? sendBuffer.getNumSamples() : numSamples;
+    SmoothedParameter feedbackAfter;
+    processChannelGroups(numSamples, [&] (int firstGroup, int numGroups) {
+        SmoothedParameter feedback = feedbackSmoother;
+        const auto range = getChannelRange(firstGroup, numGroups, numChannels);
+        SampleType* const* block = channels + range.getFirstChannel();
+        for (int start = startSample; start < end;) {
+            const int length = feedback.getNumSamplesAtCurrentStep(std::min(maxLength, end - start));
+            const float* const* send = colour ? colourSend(firstGroup, numGroups, numChannels, channels, start, length) : nullptr;
+            range.processTapsInPlace(block, start, length, activeTaps.data(), tapCount,
+                                     feedback.getCurrentValue(), feedback.getStep(), send);
+            feedback.skip(length);
+            start += length;
+        }
+        if (firstGroup == 0)
+            feedbackAfter = feedback;
+    });
+    feedbackSmoother = feedbackAfter;
+}
+
+template <typename SampleType>
+void MyGreatProjectAudioProcessor::processReverb(SampleType* const* channels, int numChannels, int startSample, int numSamples) {
+    //in reverb mode the feedback parameter is the wet level; the decay comes from rt60. the network mixes every line
+    //into every other one each sample, so it has nothing to split across threads and runs the same offline
+    reverb.setNumLines(fdnSizeParameter->load(std::memory_order_relaxed) > 0.5f ? 16 : 8);
+    reverb.setDecayTime(rt60Parameter->load(std::memory_order_relaxed));
+    const int end = startSample + numSamples;
+    for (int start = startSample; start < end;) {
+        const int length = feedbackSmoother.getNumSamplesAtCurrentStep(end - start);
+        reverb.processInPlace(channels, numChannels, start, length,
+                              feedbackSmoother.getCurrentValue(), feedbackSmoother.getStep());
+        feedbackSmoother.skip(length);
+        start += length;
+    }
+}
+
+template <typename SampleType>
+void MyGreatProjectAudioProcessor::processGranular(SampleType* const* channels, int numChannels, int startSample, int numSamples) {
+    //every grain reads all channels with one window and position, so the grains can't be split across threads like
+    //channel groups: this runs on the audio thread alone, like the reverb. the colour stage still colours the send
+    auto settings = getGrainSettings(currentSampleRate);
+    settings.delaySamples -= static_cast<float>(getCharacter().getLatencySamples());
+    grains.setSettings(settings);
+    reserveDelay(GranularDelay::getReach(settings)); //grains that don't fit yet start closer, see GranularDelay::spawn
+
+    const bool colour = getCharacter().isActive();
+    const int numGroups = static_cast<int>(channelGroups.size());
+    const int end = startSample + numSamples;
+    for (int start = startSample; start < end;) {
+        const int length = feedbackSmoother.getNumSamplesAtCurrentStep(std::min(sendBuffer.getNumSamples(), end - start));
+        const float* const* send = colour ? colourSend(0, numGroups, numChannels, channels, start, length) : nullptr;
+        grains.processInPlace(delayLine, channels, numChannels, start, length,
+                              feedbackSmoother.getCurrentValue(), feedbackSmoother.getStep(), send);
+        feedbackSmoother.skip(length);
+        start += length;
     }
 }
 
+void MyGreatProjectAudioProcessor::updateCharacter() noexcept {
+    //an offline render can afford the cleanest clipper whatever the setting; its latency is taken off the delay
+    //like any other, and the setting comes back with realtime playback
+    const auto antialiasing = renderingOffline ? FeedbackCharacter::Antialiasing::oversample4x
+                                               : static_cast<FeedbackCharacter::Antialiasing>(static_cast<int>(antialiasingParameter->load(std::memory_order_relaxed)));
+    for (auto& group : channelGroups) {
+        group.character.setTone(toneParameter->load(std::memory_order_relaxed));
+        group.character.setDrive(driveParameter->load(std::memory_order_relaxed));
+        group.character.setAntialiasing(antialiasing);
+    }
+}
+
+//calls process (firstGroup, numGroups) for batches of channel groups that together cover the bus, then moves the line
+//on. long enough chunks go to the threads one group each: the render threads offline, this instance's workers for a
+//wide bus in realtime. everything else is one batch. a group's output doesn't depend on the thread that ran it
+template <typename GroupFunction>
+void MyGreatProjectAudioProcessor::processChannelGroups(int numSamples, GroupFunction&& process) {
+    const int numGroups = static_cast<int>(channelGroups.size());
+    auto task = [&process] (int group) { process(group, 1); };
+    if (numGroups > 1 && renderingOffline && numSamples >= OFFLINE_PARALLEL_MIN_SAMPLES)
+        renderPool->run(numGroups, task);
+    else if (numGroups > 1 && !renderingOffline && realtimePool.getNumWorkers() > 0 && numSamples >= REALTIME_PARALLEL_MIN_SAMPLES)
+        realtimePool.run(numGroups, task);
+    else
+        process(0, numGroups);
+    delayLine.advance(numSamples);
+}
+
+//the line's channels the groups [firstGroup, firstGroup + numGroups) cover, short of any the block doesn't have
+DelayLine::ChannelRange MyGreatProjectAudioProcessor::getChannelRange(int firstGroup, int numGroups, int numChannels) noexcept {
+    const auto& last = channelGroups[static_cast<size_t>(firstGroup + numGroups - 1)];
+    const int first = channelGroups[static_cast<size_t>(firstGroup)].firstChannel;
+    return delayLine.getChannelRange(first, std::min(numChannels, last.firstChannel + last.numChannels) - first);
+}
+
+//copies [startSample, startSample + numSamples) of the groups' channels into the send buffer and colours them there,
+//leaving the dry block alone. returns the send for the groups' first channel on
+template <typename SampleType>
+const float* const* MyGreatProjectAudioProcessor::colourSend(int firstGroup, int numGroups, int numChannels, const SampleType* const* channels,
+                                                             int startSample, int numSamples) noexcept {
+    //the colour stage runs in float whatever the host's precision: its output only goes into the line, which is float too
+    numChannels = std::min(numChannels, sendBuffer.getNumChannels());
+    for (int g = firstGroup; g < firstGroup + numGroups; ++g) {
+        auto& group = channelGroups[static_cast<size_t>(g)];
+        const int count = std::clamp(numChannels - group.firstChannel, 0, group.numChannels);
+        for (int ch = group.firstChannel; ch < group.firstChannel + count; ++ch)
+            std::copy_n(channels[ch] + startSample, numSamples, sendChannels[ch]);
+        group.character.process(sendChannels + group.firstChannel, count, 0, numSamples);
+    }
+    return sendChannels + channelGroups[static_cast<size_t>(firstGroup)].firstChannel;
+}
+
+//push a block to the first numChannels delay lines. each block is written into its line scaled by feedback, and blocksOut receives the block of equal length that was written delayLengthSmp samples ago.
+void MyGreatProjectAudioProcessor::pushToBuffer(const float* const* sampleBlocks, float* const* blocksOut, int numChannels,
+                                                  int blockLength) {
+    delayLine.process(sampleBlocks, blocksOut, numChannels, blockLength, static_cast<int>(delayLengthSmp), getDelayFeedback());
+}
+
 //==============================================================================
 bool MyGreatProjectAudioProcessor::hasEditor() const
 {
@@ -219,24 +805,215 @@ juce::AudioProcessorEditor* MyGreatProjectAudioProcessor::createEditor()
 //==============================================================================
 void MyGreatProjectAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    // You should use this method to store your parameters in the memory block.
-    // You could do that either as raw data, or use the XML or ValueTree classes
-    // as intermediaries to make it easy to save and load complex data.
+    //the host calls this off the audio thread, which keeps playing: parameters and taps are read from their atomics,
+    //and the tail is copied from the live line without stopping it (see captureTail)
+    PluginState state;
+    for (const auto& [tag, id] : stateParameterTags)
+        state.parameterValues.push_back({ tag, parameters.getRawParameterValue(id)->load(std::memory_order_relaxed) });
+    const int tapCount = getNumTaps();
+    for (int t = 0; t < tapCount; ++t) {
+        const auto& tap = tapSettings[static_cast<size_t>(t)];
+        state.taps.push_back({ tap.seconds.load(std::memory_order_relaxed), tap.gain.load(std::memory_order_relaxed),
+                               tap.pan.load(std::memory_order_relaxed) });
+    }
+    for (int cc = 0; cc < 128; ++cc)
+        if (const auto* parameter = controllerMap[static_cast<size_t>(cc)].load(std::memory_order_relaxed))
+            for (const auto& [tag, id] : stateParameterTags)
+                if (parameter == parameters.getParameter(id))
+                    state.controllerMappings.push_back({ static_cast<uint8_t>(cc), tag });
+    state.program = currentProgram.load(std::memory_order_relaxed);
+    state.storageFormat = static_cast<int>(getStorageFormat());
+    if (saveTailInState)
+        state.tail = captureTail();
+    state.write(destData);
 }
 
 void MyGreatProjectAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    // You should use this method to restore your parameters from this memory block,
-    // whose contents will have been created by the getStateInformation() call.
+    //a state this version can't read (or an empty one from before states were saved) leaves everything as it is
+    PluginState state;
+    if (data == nullptr || sizeInBytes <= 0 || !state.read(data, static_cast<size_t>(sizeInBytes)))
+        return;
+
+    for (const auto& [tag, value] : state.parameterValues)
+        if (const char* id = getStateParameterID(tag)) {
+            auto* parameter = parameters.getParameter(id);
+            parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+        }
+    const int tapCount = std::min(static_cast<int>(state.taps.size()), DelayLine::maxTaps);
+    for (int t = 0; t < tapCount; ++t) {
+        const auto& tap = state.taps[static_cast<size_t>(t)];
+        setTap(t, tap.seconds, tap.gain, tap.pan);
+    }
+    setNumTaps(tapCount);
+    for (int cc = 0; cc < 128; ++cc)
+        setControllerMapping(cc, {});
+    for (const auto& [controller, tag] : state.controllerMappings)
+        if (const char* id = getStateParameterID(tag))
+            setControllerMapping(controller, id);
+    currentProgram.store(std::clamp(state.program, 0, numPrograms - 1), std::memory_order_relaxed);
+    setStorageFormat(static_cast<SampleFormat>(std::clamp(state.storageFormat, 0, static_cast<int>(SampleFormat::bfloat16))));
+    restoreTail(std::move(state.tail));
+}
+
+//the part of the line the engine can still read back (the longest delay in use, up to STATE_MAX_TAIL_SECONDS), without
+//the silence before it. nothing in reverb mode, where the line isn't used. a released instance keeps its line, so it
+//still has a tail, unless a restored one is waiting for prepareToPlay
+PluginState::Tail MyGreatProjectAudioProcessor::captureTail() {
+    std::lock_guard<std::mutex> guard(stateLock);
+    if (!pendingTail.isEmpty())
+        return pendingTail;
+    PluginState::Tail tail;
+    if (delayLine.getCapacity() == 0 || static_cast<Mode>(static_cast<int>(modeParameter->load(std::memory_order_relaxed))) == Mode::reverb)
+        return tail;
+
+    tail.sampleRate = currentSampleRate;
+    tail.numChannels = delayLine.getNumChannels();
+    tail.length = static_cast<int>(std::min(static_cast<double>(getLongestDelaySeconds()), STATE_MAX_TAIL_SECONDS) * currentSampleRate) + 1;
+    tail.samples.resize(static_cast<size_t>(tail.numChannels) * static_cast<size_t>(tail.length));
+    std::vector<float*> history;
+    for (int ch = 0; ch < tail.numChannels; ++ch)
+        history.push_back(tail.getChannel(ch));
+    //a copy fails if the audio thread got too far ahead of it (we were descheduled, or a host block was huge)
+    int read = 0;
+    for (int attempt = 0; attempt < STATE_TAIL_ATTEMPTS && read == 0; ++attempt)
+        read = resizer.readHistory(delayLine, history.data(), tail.numChannels, tail.length);
+    tail.keep(0, read);
+    tail.trimSilence(SILENCE_THRESHOLD);
+    return tail;
+}
+
+//a tail restored while we're prepared is built into a new line by the resizer and swapped in by the audio thread;
+//otherwise prepareToPlay writes it. a state without a tail leaves the line as it is
+void MyGreatProjectAudioProcessor::restoreTail(PluginState::Tail tail) {
+    std::lock_guard<std::mutex> guard(stateLock);
+    pendingTail = {};
+    if (tail.isEmpty())
+        return;
+
+    if (prepared) {
+        auto atRate = tail.resampled(currentSampleRate);
+        resizer.restoreHistory(delayLine, std::move(atRate.samples), atRate.numChannels, atRate.length);
+    } else {
+        pendingTail = std::move(tail);
+    }
 }
 
 void MyGreatProjectAudioProcessor::setDelayLength(float length) {
-    if (length > MAX_DELAY_LENGTH) this->length = MAX_DELAY_LENGTH;
-    else this->length = length;
+    //the parameter range caps the length at MAX_DELAY_LENGTH. a length past the line's capacity is
+    //grown into on the fly (see reserveDelay), so no prepareToPlay is needed
+    auto* parameter = parameters.getParameter(ParameterIDs::length);
+    parameter->setValueNotifyingHost(parameter->convertTo0to1(length));
 }
 
 void MyGreatProjectAudioProcessor::setDelayFeedback(float feedback) {
-    this->feedback = std::clamp(feedback, 0.0f, MAX_FEEDBACK);
+    //the parameter range clamps feedback to [0, MAX_FEEDBACK]
+    auto* parameter = parameters.getParameter(ParameterIDs::feedback);
+    parameter->setValueNotifyingHost(parameter->convertTo0to1(feedback));
+}
+
+float MyGreatProjectAudioProcessor::getDelayLength() const {
+    return lengthParameter->load(std::memory_order_relaxed);
+}
+
+float MyGreatProjectAudioProcessor::getDelayFeedback() const {
+    return feedbackParameter->load(std::memory_order_relaxed);
+}
+
+void MyGreatProjectAudioProcessor::setMode(Mode mode) {
+    auto* parameter = parameters.getParameter(ParameterIDs::mode);
+    parameter->setValueNotifyingHost(parameter->convertTo0to1(static_cast<float>(mode)));
+}
+
+void MyGreatProjectAudioProcessor::setTap(int index, float seconds, float gain, float pan) {
+    if (index < 0 || index >= DelayLine::maxTaps) return;
+    auto& settings = tapSettings[static_cast<size_t>(index)];
+    settings.seconds.store(std::clamp(seconds, 0.0f, static_cast<float>(MAX_DELAY_LENGTH)), std::memory_order_relaxed);
+    settings.gain.store(gain, std::memory_order_relaxed);
+    settings.pan.store(std::clamp(pan, -1.0f, 1.0f), std::memory_order_relaxed);
+}
+
+void MyGreatProjectAudioProcessor::setNumTaps(int newNumTaps) {
+    numTaps.store(std::clamp(newNumTaps, 0, DelayLine::maxTaps), std::memory_order_relaxed);
+}
+
+int MyGreatProjectAudioProcessor::getNumTaps() const {
+    return numTaps.load(std::memory_order_relaxed);
+}
+
+void MyGreatProjectAudioProcessor::setStorageFormat(SampleFormat format) {
+    storageFormat.store(format);
+}
+
+SampleFormat MyGreatProjectAudioProcessor::getStorageFormat() const {
+    return storageFormat.load();
+}
+
+void MyGreatProjectAudioProcessor::setChunkSize(int numSamples) {
+    chunkSize.store(juce::jlimit(SUBBLOCK_MIN_SAMPLES, MAX_CHUNK_SAMPLES, numSamples));
+}
+
+int MyGreatProjectAudioProcessor::getChunkSize() const {
+    return chunkSize.load();
+}
+
+size_t MyGreatProjectAudioProcessor::getMemoryUsage() const {
+    return delayLine.getMemoryUsage() + reverb.getMemoryUsage() + grains.getMemoryUsage();
+}
+
+DelayBufferPool::Stats MyGreatProjectAudioProcessor::getBufferPoolStats() const {
+    return bufferPool->getStats();
+}
+
+juce::AudioProcessorValueTreeState::ParameterLayout MyGreatProjectAudioProcessor::createParameterLayout() {
+    using namespace juce;
+    AudioProcessorValueTreeState::ParameterLayout layout;
+    layout.add(std::make_unique<AudioParameterFloat>(ParameterID { ParameterIDs::feedback, 1 }, "Feedback",
+                                                     NormalisableRange<float>(0.0f, MAX_FEEDBACK), 0.5f));
+    //minutes of range, but most of the travel stays on the musically useful first few seconds
+    NormalisableRange<float> lengthRange(0.0f, static_cast<float>(MAX_DELAY_LENGTH));
+    lengthRange.setSkewForCentre(2.0f);
+    layout.add(std::make_unique<AudioParameterFloat>(ParameterID { ParameterIDs::length, 1 }, "Length", lengthRange, 1.0f,
+                                                     AudioParameterFloatAttributes().withLabel("s")));
+    layout.add(std::make_unique<AudioParameterChoice>(ParameterID { ParameterIDs::mode, 1 }, "Mode",
+                                                      StringArray { "Delay", "Multi-tap", "FDN reverb", "Granular" }, 0));
+    layout.add(std::make_unique<AudioParameterFloat>(ParameterID { ParameterIDs::rt60, 1 }, "Decay time",
+                                                     NormalisableRange<float>(0.1f, 20.0f, 0.0f, 0.4f), 2.0f,
+                                                     AudioParameterFloatAttributes().withLabel("s")));
+    layout.add(std::make_unique<AudioParameterChoice>(ParameterID { ParameterIDs::fdnSize, 1 }, "Reverb lines",
+                                                      StringArray { "8", "16" }, 0));
+    //colour of the delayed signal: fully open and undriven by default, which bypasses the stage
+    layout.add(std::make_unique<AudioParameterFloat>(ParameterID { ParameterIDs::tone, 1 }, "Tone",
+                                                     NormalisableRange<float>(200.0f, FeedbackCharacter::maxToneHz, 0.0f, 0.3f),
+                                                     FeedbackCharacter::maxToneHz, AudioParameterFloatAttributes().withLabel("Hz")));
+    layout.add(std::make_unique<AudioParameterFloat>(ParameterID { ParameterIDs::drive, 1 }, "Drive",
+                                                     NormalisableRange<float>(0.0f, 24.0f), 0.0f,
+                                                     AudioParameterFloatAttributes().withLabel("dB")));
+    //cpu against quality, per instance: ADAA is nearly free, 2x/4x oversampling is cleaner and adds a little latency
+    layout.add(std::make_unique<AudioParameterChoice>(ParameterID { ParameterIDs::antialiasing, 1 }, "Saturation quality",
+                                                      StringArray { "Plain", "ADAA", "2x oversampled", "4x oversampled" }, 1));
+    //granular mode: grains read from the delay back, spread over the spray, at the pitch (reversed with the given
+    //probability). the shimmer feeds them back in, so each repeat is pitched again
+    NormalisableRange<float> grainSizeRange(10.0f, 1000.0f);
+    grainSizeRange.setSkewForCentre(100.0f);
+    layout.add(std::make_unique<AudioParameterFloat>(ParameterID { ParameterIDs::grainSize, 1 }, "Grain size", grainSizeRange, 100.0f,
+                                                     AudioParameterFloatAttributes().withLabel("ms")));
+    NormalisableRange<float> densityRange(1.0f, 500.0f);
+    densityRange.setSkewForCentre(30.0f);
+    layout.add(std::make_unique<AudioParameterFloat>(ParameterID { ParameterIDs::grainDensity, 1 }, "Density", densityRange, 20.0f,
+                                                     AudioParameterFloatAttributes().withLabel("grains/s")));
+    NormalisableRange<float> sprayRange(0.0f, 1000.0f);
+    sprayRange.setSkewForCentre(100.0f);
+    layout.add(std::make_unique<AudioParameterFloat>(ParameterID { ParameterIDs::grainSpray, 1 }, "Spray", sprayRange, 0.0f,
+                                                     AudioParameterFloatAttributes().withLabel("ms")));
+    layout.add(std::make_unique<AudioParameterFloat>(ParameterID { ParameterIDs::grainPitch, 1 }, "Pitch",
+                                                     NormalisableRange<float>(-24.0f, 24.0f, 0.01f), 0.0f,
+                                                     AudioParameterFloatAttributes().withLabel("st")));
+    layout.add(std::make_unique<AudioParameterFloat>(ParameterID { ParameterIDs::grainReverse, 1 }, "Reverse",
+                                                     NormalisableRange<float>(0.0f, 1.0f), 0.0f));
+    layout.add(std::make_unique<AudioParameterFloat>(ParameterID { ParameterIDs::shimmer, 1 }, "Shimmer",
+                                                     NormalisableRange<float>(0.0f, 0.95f), 0.0f));
+    return layout;
 }
 
 void MyGreatProjectAudioProcessor::test(bool val, std::string message) {
@@ -248,24 +1025,24 @@ void MyGreatProjectAudioProcessor::test(bool val, std::string message) {
 
 void MyGreatProjectAudioProcessor::runTests() {
     try {
-        const float currentLength = length;
+        const float currentLength = getDelayLength();
         //first test: delay length: a. can be set; b. is capped properly
         setDelayLength(2.0);
-        test(std::abs(length - 2.0) <= 0.0001, "");
+        test(std::abs(getDelayLength() - 2.0) <= 0.0001, "");
         setDelayLength(MAX_DELAY_LENGTH + 1);
-        test(length == MAX_DELAY_LENGTH, "");
+        test(std::abs(getDelayLength() - MAX_DELAY_LENGTH) <= 0.0001, "");
 
         //second test: can set feedback amount
-        const float currentFeedback = feedback;
+        const float currentFeedback = getDelayFeedback();
         setDelayFeedback(0.4);
-        test(std::abs(feedback - 0.4) < 0.0001, "");
+        test(std::abs(getDelayFeedback() - 0.4) < 0.0001, "");
         //third test: feedback amount clamps correctly
         setDelayFeedback(1.2); //should clamp
-        test(feedback <= MAX_FEEDBACK, "");
+        test(getDelayFeedback() <= MAX_FEEDBACK, "");
         //fourth test: buffer allocates correctly
         int blockSize = 10;
         this->prepareToPlay(100, blockSize);
-        test(buffer_left.size() == 100 * MAX_DELAY_LENGTH, ""); // NOLINT(*-narrowing-conversions)
+        test(delayLine.getCapacity() >= 100 * getDelayLength(), "");
         //fifth test: can push a block of samples to our hypothetical vector, multiple times, and receive the correct value
         delayLengthSmp = 50; //we only use the first half of the array. this value is reset on prepareToPlay so it's fine to modify
         setDelayFeedback(0.5);
@@ -273,12 +1050,16 @@ void MyGreatProjectAudioProcessor::runTests() {
         using namespace juce;
         std::vector input = {0.25f, 0.5f, 1.0f, 0.25f, 0.5f, 1.0f, 0.25f, 0.5f, 1.0f, 0.5f}; //dummy "audio"
         std::vector expected = input;
-        FloatVectorOperations::multiply(expected.data(), feedback, input.size());
+        FloatVectorOperations::multiply(expected.data(), getDelayFeedback(), input.size());
         float finalOutput[blockSize];
-        pushToBuffer(input.data(), finalOutput, 10, 'l'); //push initial values
+        float* outputChannels[] = { finalOutput };
+        const float* inputChannels[] = { input.data() };
+        pushToBuffer(inputChannels, outputChannels, 1, 10); //push initial values
         //that expected data should come back after 5 blocks
+        std::vector<float> silence(10);
+        const float* silenceChannels[] = { silence.data() };
         for (int i = 0; i<(delayLengthSmp/blockSize); i++) {
-            pushToBuffer(std::vector<float>(10).data(), finalOutput, blockSize, 'l'); //push 5 blocks of zeroes
+            pushToBuffer(silenceChannels, outputChannels, 1, blockSize); //push 5 blocks of zeroes
         }
         bool equal = true;
         //check they're equal
@@ -9,12 +9,42 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "DelayLine.h"
+#include "DelayLineResizer.h"
+#include "DspLoadProfiler.h"
+#include "FeedbackCharacter.h"
+#include "FeedbackDelayNetwork.h"
+#include "GranularDelay.h"
+#include "PluginState.h"
+#include "RealtimeThreadPool.h"
+#include "RenderThreadPool.h"
+#include "SmoothedParameter.h"
+#include "Telemetry.h"
+
+namespace ParameterIDs
+{
+    static constexpr auto feedback = "feedback";
+    static constexpr auto length   = "length";
+    static constexpr auto mode     = "mode";
+    static constexpr auto rt60     = "rt60";
+    static constexpr auto fdnSize  = "fdnSize";
+    static constexpr auto tone     = "tone";
+    static constexpr auto drive    = "drive";
+    static constexpr auto antialiasing = "antialiasing";
+    static constexpr auto grainSize    = "grainSize";
+    static constexpr auto grainDensity = "grainDensity";
+    static constexpr auto grainSpray   = "grainSpray";
+    static constexpr auto grainPitch   = "grainPitch";
+    static constexpr auto grainReverse = "grainReverse";
+    static constexpr auto shimmer      = "shimmer";
+}
 
 //==============================================================================
 /**
 */
 
-class MyGreatProjectAudioProcessor  : public juce::AudioProcessor
+class MyGreatProjectAudioProcessor  : public juce::AudioProcessor,
+                                      private juce::Timer
 {
 
 
@@ -35,8 +65,10 @@ public:
    #endif
 
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    void processBlock (juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
+    bool supportsDoublePrecisionProcessing() const override;
 
-    void pushToBuffer(const float *sampleBlock, float *blockOut, int blockLength, char side);
+    void pushToBuffer(const float* const* sampleBlocks, float* const* blocksOut, int numChannels, int blockLength);
 
     //==============================================================================
     juce::AudioProcessorEditor* createEditor() override;
@@ -61,32 +93,195 @@ public:
     void getStateInformation (juce::MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
 
+    //these go through the host-visible parameters, so call them from the message thread
     void setDelayLength(float len);
 
     void setDelayFeedback(float feedback);
 
+    float getDelayLength() const;
+
+    float getDelayFeedback() const;
+
+    static juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
+
+    //the choices of the mode parameter, in order
+    enum class Mode { delay = 0, multiTap, reverb, granular };
+
+    void setMode(Mode mode);
+
+    //multi-tap mode: up to DelayLine::maxTaps read points on the same line. pan (-1 to 1) only applies to
+    //stereo buses. these can be called from any thread; the audio thread picks the taps up at its next block
+    void setTap(int index, float seconds, float gain, float pan);
+
+    void setNumTaps(int numTaps);
+
+    int getNumTaps() const;
+
+    //how the delay line stores samples. 16-bit formats halve its memory for some precision;
+    //a change takes effect at the next prepareToPlay, since it means reallocating the line
+    void setStorageFormat(SampleFormat format);
+
+    SampleFormat getStorageFormat() const;
+
+    //processBlock works through host blocks this many samples at a time, whatever size the host prepared for or
+    //actually sends, so each chunk's passes stay in cache (offline renders use longer chunks, see enhanceOfflineRender).
+    //clamped to [SUBBLOCK_MIN_SAMPLES, MAX_CHUNK_SAMPLES]; like the storage format, it takes effect at the next prepareToPlay
+    void setChunkSize(int numSamples);
+
+    int getChunkSize() const;
+
+    //midi cc -> parameter (by ID; an empty ID unmaps it). CCs 20-25 start out mapped to feedback, length, tone,
+    //drive, mode and rt60. call from the message thread; the audio thread sees the change at its next event
+    void setControllerMapping(int controllerNumber, const juce::String& parameterID);
+
+    //bytes of sample memory this instance holds right now (delay line and reverb)
+    size_t getMemoryUsage() const;
+
+    //occupancy of the delay memory pool shared by every instance in the process
+    DelayBufferPool::Stats getBufferPoolStats() const;
+
     void test(bool val, std::string message);
 
+    //diagnostics: prepares this instance at 100 Hz and checks the parameters and the echo, muting the output
+    //if anything fails. it leaves the instance in a test state, so run it on a throwaway processor
+    //(MyGreatProject_Benchmark --self-test does this)
     void runTests();
 
     static juce::String array_to_string(float *arr, int len);
 
     //=========
     static int getMagicNumber();
-    float feedback = 0.5; //from 0 to 1
-    float length = 1.0;
-    unsigned long delayLengthSmp = -1; //set in the prepareToPlay function
+    juce::AudioProcessorValueTreeState parameters;
+    unsigned long delayLengthSmp = -1; //the delay being read (or faded towards), set in the prepareToPlay function
     std::vector<std::string> messages = {};
 
     bool output = true;
+    bool resampleOnRateChange = true; //keep the echo tail across sample rate changes instead of clearing it
+    bool enhanceOfflineRender = true; //when the host renders offline: 4x oversampled colour stage, channel groups in parallel
+    bool saveTailInState = false; //getStateInformation includes the newest part of the delay line (up to the longest delay in use), so a recalled instance resumes its echoes. off by default: hosts save state often
+    bool splitWideBuses = true; //in realtime, buses of 16 channels or more spread their channel groups over worker threads
     //======
-    std::vector<float> buffer_left;
-    std::vector<float> buffer_right;
-    std::vector<float> block_vector;
-    std::vector<float> block_vector_2;
+    DelayLine delayLine; //one line per channel, all in one allocation, sized to the delay in use
+    FeedbackDelayNetwork reverb; //reverb mode, independent of delayLine; its lines are only held while the mode is selected
+    GranularDelay grains; //granular mode: reads and writes delayLine
+    TelemetryFifo telemetry; //audio thread -> editor, one frame per block while an editor is open
+    DspLoadProfiler profiler; //block timing against the callback budget, off until someone enables it
     //======
     std::vector<bool> tests;
 private:
+    //held for the lifetime of the instance, so blocks freed by one instance stay pooled for the others
+    std::shared_ptr<DelayBufferPool> bufferPool = DelayBufferPool::getInstance();
+    std::shared_ptr<RenderThreadPool> renderPool = RenderThreadPool::getInstance();
+    RealtimeThreadPool realtimePool; //this instance's own: started in prepareToPlay for wide buses, see splitWideBuses
+
+    struct TapSettings
+    {
+        std::atomic<float> seconds { 0.0f }, gain { 0.0f }, pan { 0.0f };
+    };
+
+    //a run of the bus's channels with its own colour stage. groups share nothing but the line, so an offline render
+    //or a wide bus can process them on different threads; every group gets the same settings, so the first one speaks for all
+    struct ChannelGroup
+    {
+        int firstChannel = 0, numChannels = 0;
+        FeedbackCharacter character;
+    };
+
+    int getTargetDelaySamples() const noexcept;
+    float getLongestDelaySeconds() const noexcept; //the delay time, the longest active tap, or as far back as grains read
+    GranularDelay::Settings getGrainSettings(double sampleRate) const noexcept;
+    int reserveDelay(int delaySamples) noexcept;
+    bool isIdle(float inputPeak, int numSamples) noexcept;
+    //the engine, for float or double host buffers: both processBlock overloads run it natively
+    template <typename SampleType>
+    void processBlockImpl(juce::AudioBuffer<SampleType>& buffer, juce::MidiBuffer& midiMessages);
+    template <typename SampleType>
+    void processSubBlock(SampleType* const* channels, int numChannels, int startSample, int numSamples);
+    template <typename SampleType>
+    void processDelay(SampleType* const* channels, int numChannels, int startSample, int numSamples);
+    template <typename SampleType>
+    void processMultiTap(SampleType* const* channels, int numChannels, int startSample, int numSamples);
+    template <typename SampleType>
+    void processReverb(SampleType* const* channels, int numChannels, int startSample, int numSamples);
+    template <typename SampleType>
+    void processGranular(SampleType* const* channels, int numChannels, int startSample, int numSamples);
+    void handleMidiEvent(const juce::MidiMessage& message, int64_t time);
+    void tapTempo(int64_t time);
+    void setParameterFromAudioThread(juce::RangedAudioParameter* parameter, float normalisedValue) noexcept;
+    void timerCallback() override;
+    void updateCharacter() noexcept;
+    const FeedbackCharacter& getCharacter() const noexcept { return channelGroups.front().character; }
+    PluginState::Tail captureTail();
+    void restoreTail(PluginState::Tail tail);
+    template <typename GroupFunction>
+    void processChannelGroups(int numSamples, GroupFunction&& process);
+    DelayLine::ChannelRange getChannelRange(int firstGroup, int numGroups, int numChannels) noexcept;
+    template <typename SampleType>
+    const float* const* colourSend(int firstGroup, int numGroups, int numChannels, const SampleType* const* channels,
+                                   int startSample, int numSamples) noexcept;
+
+    //audio thread only: parameters are read from the atomics once per block and ramped from there
+    std::atomic<float>* feedbackParameter = nullptr;
+    std::atomic<float>* lengthParameter = nullptr;
+    std::atomic<float>* modeParameter = nullptr;
+    std::atomic<float>* rt60Parameter = nullptr;
+    std::atomic<float>* fdnSizeParameter = nullptr;
+    std::atomic<float>* toneParameter = nullptr;
+    std::atomic<float>* driveParameter = nullptr;
+    std::atomic<float>* antialiasingParameter = nullptr;
+    std::atomic<float>* grainSizeParameter = nullptr;
+    std::atomic<float>* grainDensityParameter = nullptr;
+    std::atomic<float>* grainSprayParameter = nullptr;
+    std::atomic<float>* grainPitchParameter = nullptr;
+    std::atomic<float>* grainReverseParameter = nullptr;
+    std::atomic<float>* shimmerParameter = nullptr;
+    double currentSampleRate = 0.0; //0 until the first prepareToPlay
+    SmoothedParameter feedbackSmoother;
+    SmoothedParameter delayFade; //0 -> 1 while crossfading from fadingFromDelaySmp to delayLengthSmp
+    int fadingFromDelaySmp = 0;
+
+    DelayLineResizer resizer; //grows delayLine off the audio thread when a longer delay is asked for
+    DelayLineResizer reverbResizer; //allocates and frees the reverb's lines off the audio thread as the mode changes
+    //message-side threads only: the host may save or restore state on another thread than the one it prepares on
+    std::mutex stateLock;
+    bool prepared = false; //between prepareToPlay and releaseResources, so the audio thread swaps restored lines in
+    PluginState::Tail pendingTail; //restored before the host prepared us: written into the line by prepareToPlay
+    std::vector<ChannelGroup> channelGroups; //at least one, laid out in prepareToPlay
+    juce::AudioBuffer<float> sendBuffer; //the coloured copy of the input, one chunk at a time
+    float* const* sendChannels = nullptr; //sendBuffer's channels, taken once so group threads never touch the buffer object
+    int chunkSamples = 0; //audio thread's copy of chunkSize, set in prepareToPlay
+    bool renderingOffline = false; //audio thread: the current block is an offline render, with enhanceOfflineRender on
+    int64_t silentSamples = 0; //how long the input has been below SILENCE_THRESHOLD
+    int silentMode = 0; //the mode silentSamples was counted in
+
+    std::atomic<SampleFormat> storageFormat { SampleFormat::float32 };
+    std::atomic<int> chunkSize;
+
+    std::array<TapSettings, DelayLine::maxTaps> tapSettings;
+    std::atomic<int> numTaps { 0 };
+    std::array<DelayLine::Tap, DelayLine::maxTaps> activeTaps; //audio thread's copy, converted to samples and pan gains
+
+    //midi: controller map (any thread), then audio thread state for tap tempo
+    std::array<std::atomic<juce::RangedAudioParameter*>, 128> controllerMap {};
+    std::atomic<int> currentProgram { 0 };
+    std::array<juce::RangedAudioParameter*, 6> programParameters {}; //mode, length, feedback, tone, drive, rt60: looked up once, since lookups allocate
+
+    //parameters MIDI can change (every saved one). the audio thread writes the value the DSP reads straight away and
+    //flags the parameter; timerCallback tells the host on the message thread, once for however many changes
+    struct AudioThreadParameter
+    {
+        juce::RangedAudioParameter* parameter = nullptr;
+        std::atomic<float>* value = nullptr; //the plain value the DSP reads
+        std::atomic<float> normalisedValue { 0.0f }; //the newest value set by MIDI, for the host
+    };
+    std::array<AudioThreadParameter, 32> audioThreadParameters;
+    int numAudioThreadParameters = 0;
+    std::atomic<uint32_t> parametersToNotify { 0 }; //one bit per audioThreadParameters entry
+    int64_t samplesProcessed = 0; //the clock tap tempo measures intervals on
+    int64_t lastTapTime = std::numeric_limits<int64_t>::min() / 2;
+    std::array<double, 4> tapIntervals {};
+    int numTapIntervals = 0;
+
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MyGreatProjectAudioProcessor)
 };
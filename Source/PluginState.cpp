@@ -0,0 +1,244 @@
+/*
+  ==============================================================================
+
+    PluginState.cpp
+
+  ==============================================================================
+*/
+
+#include "PluginState.h"
+#include "SampleFormat.h"
+
+#define STATE_MAX_TAIL_SAMPLES (1 << 26) //all channels together; anything bigger is a corrupt size, not a tail
+
+namespace
+{
+    const char magic[4] = { 'M', 'G', 'P', 'S' };
+
+    //section ids: never reuse one for something else
+    enum Section : uint8_t
+    {
+        parametersSection = 1,  //{ u8 tag, f32 value } ...
+        tapsSection,            //{ f32 seconds, f32 gain, f32 pan } ...
+        controllersSection,     //{ u8 controller, u8 parameter tag } ...
+        settingsSection,        //u8 program, u8 storage format (older states follow with an i32 chunk size, which is skipped)
+        tailSection             //f64 sample rate, u16 channels, i32 length, u8 encoding, deflated samples
+    };
+
+    constexpr uint8_t int16DeltaDeflated = 1;
+
+    void writeSection (juce::MemoryOutputStream& out, Section id, const juce::MemoryOutputStream& payload) {
+        out.writeByte (static_cast<char> (id));
+        out.writeInt (static_cast<int> (payload.getDataSize()));
+        out.write (payload.getData(), payload.getDataSize());
+    }
+
+    void writeTail (juce::MemoryOutputStream& out, const PluginState::Tail& tail) {
+        out.writeDouble (tail.sampleRate);
+        out.writeShort (static_cast<short> (tail.numChannels));
+        out.writeInt (tail.length);
+        out.writeByte (static_cast<char> (int16DeltaDeflated));
+
+        //neighbouring samples are close, so their differences are small numbers that deflate well
+        juce::GZIPCompressorOutputStream deflated (out);
+        std::vector<uint8_t> bytes (static_cast<size_t> (tail.length) * 2);
+        for (int ch = 0; ch < tail.numChannels; ++ch) {
+            const float* samples = tail.getChannel (ch);
+            uint16_t previous = 0;
+            for (int i = 0; i < tail.length; ++i) {
+                const auto sample = static_cast<uint16_t> (Int16Codec::encode (samples[i]));
+                const auto delta = static_cast<uint16_t> (sample - previous);
+                bytes[static_cast<size_t> (i) * 2] = static_cast<uint8_t> (delta & 0xff);
+                bytes[static_cast<size_t> (i) * 2 + 1] = static_cast<uint8_t> (delta >> 8);
+                previous = sample;
+            }
+            deflated.write (bytes.data(), bytes.size());
+        }
+        deflated.flush();
+    }
+
+    bool readTail (juce::MemoryInputStream& in, PluginState::Tail& tail) {
+        tail.sampleRate = in.readDouble();
+        tail.numChannels = static_cast<uint16_t> (in.readShort());
+        tail.length = in.readInt();
+        if (in.readByte() != static_cast<char> (int16DeltaDeflated) || tail.sampleRate <= 0.0 || tail.length <= 0
+            || static_cast<int64_t> (tail.numChannels) * tail.length > STATE_MAX_TAIL_SAMPLES)
+            return false;
+
+        juce::GZIPDecompressorInputStream inflated (in);
+        tail.samples.resize (static_cast<size_t> (tail.numChannels) * static_cast<size_t> (tail.length));
+        std::vector<uint8_t> bytes (static_cast<size_t> (tail.length) * 2);
+        for (int ch = 0; ch < tail.numChannels; ++ch) {
+            if (inflated.read (bytes.data(), static_cast<int> (bytes.size())) != static_cast<int> (bytes.size()))
+                return false;
+            float* samples = tail.getChannel (ch);
+            uint16_t sample = 0;
+            for (int i = 0; i < tail.length; ++i) {
+                sample = static_cast<uint16_t> (sample + (bytes[static_cast<size_t> (i) * 2] | (bytes[static_cast<size_t> (i) * 2 + 1] << 8)));
+                samples[i] = Int16Codec::decode (static_cast<int16_t> (sample));
+            }
+        }
+        return true;
+    }
+}
+
+//==============================================================================
+void PluginState::Tail::trimSilence (float threshold) {
+    int first = length;
+    for (int ch = 0; ch < numChannels; ++ch) {
+        const float* channel = getChannel (ch);
+        for (int i = 0; i < first; ++i)
+            if (std::abs (channel[i]) >= threshold) {
+                first = i;
+                break;
+            }
+    }
+    keep (first, length - first);
+}
+
+void PluginState::Tail::keep (int first, int count) {
+    first = std::clamp (first, 0, length);
+    count = std::clamp (count, 0, length - first);
+    if (first == 0 && count == length)
+        return;
+
+    //channel by channel, each kept part moves down to its new, shorter stride
+    for (int ch = 0; ch < numChannels; ++ch)
+        std::copy_n (getChannel (ch) + first, count, samples.data() + static_cast<size_t> (ch) * static_cast<size_t> (count));
+    length = count;
+    if (length == 0)
+        numChannels = 0;
+    samples.resize (static_cast<size_t> (numChannels) * static_cast<size_t> (length));
+}
+
+PluginState::Tail PluginState::Tail::resampled (double newSampleRate) const {
+    if (isEmpty() || newSampleRate <= 0.0 || newSampleRate == sampleRate)
+        return *this;
+
+    //both ends stay put: the newest sample is still the newest, and the oldest is still as many seconds back
+    const double ratio = newSampleRate / sampleRate;
+    Tail result;
+    result.sampleRate = newSampleRate;
+    result.numChannels = numChannels;
+    result.length = std::max (1, static_cast<int> ((length - 1) * ratio) + 1);
+    result.samples.resize (static_cast<size_t> (numChannels) * static_cast<size_t> (result.length));
+    for (int ch = 0; ch < numChannels; ++ch) {
+        const float* from = getChannel (ch);
+        float* to = result.getChannel (ch);
+        for (int i = 0; i < result.length; ++i) {
+            //ages counted back from the newest sample, which is where the line's read heads measure them from
+            const double age = (result.length - 1 - i) / ratio;
+            const int a = std::min (static_cast<int> (age), length - 1);
+            const float frac = static_cast<float> (age - a);
+            const float newer = from[length - 1 - a];
+            const float older = from[std::max (0, length - 2 - a)];
+            to[i] = newer + frac * (older - newer);
+        }
+    }
+    return result;
+}
+
+//==============================================================================
+void PluginState::write (juce::MemoryBlock& destData) const {
+    juce::MemoryOutputStream out (destData, false);
+    out.write (magic, sizeof (magic));
+    out.writeByte (static_cast<char> (version));
+
+    juce::MemoryOutputStream parameters;
+    for (const auto& [tag, value] : parameterValues) {
+        parameters.writeByte (static_cast<char> (tag));
+        parameters.writeFloat (value);
+    }
+    writeSection (out, parametersSection, parameters);
+
+    juce::MemoryOutputStream tapList;
+    for (const auto& tap : taps) {
+        tapList.writeFloat (tap.seconds);
+        tapList.writeFloat (tap.gain);
+        tapList.writeFloat (tap.pan);
+    }
+    writeSection (out, tapsSection, tapList);
+
+    juce::MemoryOutputStream controllers;
+    for (const auto& [controller, tag] : controllerMappings) {
+        controllers.writeByte (static_cast<char> (controller));
+        controllers.writeByte (static_cast<char> (tag));
+    }
+    writeSection (out, controllersSection, controllers);
+
+    juce::MemoryOutputStream settings;
+    settings.writeByte (static_cast<char> (program));
+    settings.writeByte (static_cast<char> (storageFormat));
+    writeSection (out, settingsSection, settings);
+
+    if (! tail.isEmpty()) {
+        juce::MemoryOutputStream samples;
+        writeTail (samples, tail);
+        writeSection (out, tailSection, samples);
+    }
+    out.flush();
+}
+
+bool PluginState::read (const void* data, size_t sizeInBytes) {
+    *this = {};
+    juce::MemoryInputStream in (data, sizeInBytes, false);
+    char header[sizeof (magic)] = {};
+    if (in.read (header, sizeof (header)) != static_cast<int> (sizeof (header)) || std::memcmp (header, magic, sizeof (magic)) != 0)
+        return false;
+    if (in.isExhausted() || static_cast<uint8_t> (in.readByte()) > version)
+        return false;
+
+    const auto* bytes = static_cast<const char*> (data);
+    while (! in.isExhausted()) {
+        const auto id = static_cast<uint8_t> (in.readByte());
+        const int size = in.readInt();
+        const auto start = in.getPosition();
+        if (size < 0 || size > in.getNumBytesRemaining())
+            return false;
+
+        juce::MemoryInputStream section (bytes + start, static_cast<size_t> (size), false);
+        switch (id) {
+            case parametersSection:
+                for (int i = 0; i + 5 <= size; i += 5) {
+                    const auto tag = static_cast<uint8_t> (section.readByte());
+                    parameterValues.push_back ({ tag, section.readFloat() });
+                }
+                break;
+
+            case tapsSection:
+                for (int i = 0; i + 12 <= size; i += 12) {
+                    Tap tap;
+                    tap.seconds = section.readFloat();
+                    tap.gain = section.readFloat();
+                    tap.pan = section.readFloat();
+                    taps.push_back (tap);
+                }
+                break;
+
+            case controllersSection:
+                for (int i = 0; i + 2 <= size; i += 2) {
+                    const auto controller = static_cast<uint8_t> (section.readByte());
+                    controllerMappings.push_back ({ controller, static_cast<uint8_t> (section.readByte()) });
+                }
+                break;
+
+            case settingsSection:
+                if (size >= 2) {
+                    program = static_cast<uint8_t> (section.readByte());
+                    storageFormat = static_cast<uint8_t> (section.readByte());
+                }
+                break;
+
+            case tailSection:
+                //a tail that doesn't decode is dropped; the settings are still good
+                if (! readTail (section, tail))
+                    tail = {};
+                break;
+
+            default:
+                break; //written by a newer version: skip it
+        }
+        in.setPosition (start + size);
+    }
+    return true;
+}
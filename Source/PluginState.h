@@ -0,0 +1,81 @@
+/*
+  ==============================================================================
+
+    PluginState.h
+    The binary format getStateInformation writes and setStateInformation reads.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+//==============================================================================
+/**
+    Everything a session saves for one instance, as plain values, and the
+    compact binary format it is stored in.
+
+    The format is little endian: the magic "MGPS", a version byte, then a run
+    of sections, each an id byte, a 32-bit payload size and the payload. Readers
+    skip sections they don't know, so a new section doesn't need a new version;
+    the version only goes up when an existing section changes meaning, and older
+    readers then refuse the state rather than misread it. Nothing is looked up
+    by name and nothing is allocated per value, so a session with hundreds of
+    instances loads without parsing XML for each.
+
+    Parameters and MIDI mappings refer to parameters by a one-byte tag that the
+    processor assigns and never reuses; values are stored unnormalised, so they
+    survive a change of range.
+
+    The tail, if there is one, is the newest part of the delay line: 16-bit
+    fixed point with the line's headroom (Int16Codec), first differences, then
+    deflated, so quiet and silent stretches cost next to nothing.
+*/
+struct PluginState
+{
+    static constexpr uint8_t version = 1;
+
+    struct Tap
+    {
+        float seconds = 0.0f, gain = 0.0f, pan = 0.0f;
+    };
+
+    /** The delay line's newest samples, oldest first. */
+    struct Tail
+    {
+        double sampleRate = 0.0;
+        int numChannels = 0;
+        int length = 0;                 //samples per channel
+        std::vector<float> samples;     //channel after channel
+
+        bool isEmpty() const noexcept   { return numChannels == 0 || length == 0; }
+        float* getChannel (int channel) noexcept { return samples.data() + static_cast<size_t> (channel) * static_cast<size_t> (length); }
+        const float* getChannel (int channel) const noexcept { return samples.data() + static_cast<size_t> (channel) * static_cast<size_t> (length); }
+
+        /** Keeps samples [first, first + count) of every channel and drops the rest. */
+        void keep (int first, int count);
+
+        /** Drops the oldest samples for as long as every channel stays below threshold. */
+        void trimSilence (float threshold);
+
+        /** The same tail at another sample rate (linear interpolation, like DelayLine::setSizeAndResample). */
+        Tail resampled (double newSampleRate) const;
+    };
+
+    std::vector<std::pair<uint8_t, float>> parameterValues;        //tag, plain value
+    std::vector<Tap> taps;                                          //the active multi-tap taps
+    std::vector<std::pair<uint8_t, uint8_t>> controllerMappings;    //controller number, parameter tag
+    int program = 0;
+    int storageFormat = 0;                                          //a SampleFormat
+    Tail tail;
+
+    void write (juce::MemoryBlock& destData) const;
+
+    /** False, and nothing to apply, if the data isn't a state this version can read. */
+    bool read (const void* data, size_t sizeInBytes);
+};
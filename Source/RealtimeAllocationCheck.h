@@ -0,0 +1,62 @@
+/*
+  ==============================================================================
+
+    RealtimeAllocationCheck.h
+    Debug-only guard that asserts when the audio thread touches the heap.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    Wrap the body of processBlock in a ScopedRealtimeSection and any new/delete
+    made by that thread while inside it hits a jassert.
+
+    This relies on JUCE's allocation hooks, so it is only armed in Debug builds,
+    whose configurations define JUCE_ENABLE_ALLOCATION_HOOKS (see the .jucer and
+    CMakeLists.txt); in Release the section compiles to nothing. Threads that run
+    part of a block for the audio thread (RealtimeThreadPool's workers) open a
+    section of their own, since the flag is per thread. install() registers the
+    listener and should be called off the audio thread (e.g. in prepareToPlay),
+    because registering allocates.
+*/
+namespace RealtimeAllocationCheck
+{
+   #if JUCE_DEBUG && JUCE_ENABLE_ALLOCATION_HOOKS
+    inline thread_local bool insideRealtimeSection = false;
+
+    struct Listener  : public juce::AllocationHooks::Listener
+    {
+        void newOrDeleteCalled() noexcept override {
+            //heap allocation or free on the audio thread: look at the call stack
+            if (insideRealtimeSection)
+                jassertfalse;
+        }
+    };
+
+    inline void install() {
+        static Listener listener;
+        static const bool installed = [] { juce::getAllocationHooks().addListener (&listener); return true; }();
+        juce::ignoreUnused (installed);
+    }
+
+    struct ScopedRealtimeSection
+    {
+        ScopedRealtimeSection() noexcept : wasInside (insideRealtimeSection) { insideRealtimeSection = true; }
+        ~ScopedRealtimeSection() noexcept                                   { insideRealtimeSection = wasInside; }
+
+        const bool wasInside;
+    };
+   #else
+    inline void install() {}
+
+    struct ScopedRealtimeSection
+    {
+        ScopedRealtimeSection() noexcept {}
+    };
+   #endif
+}
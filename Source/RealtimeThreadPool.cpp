@@ -0,0 +1,210 @@
+/*
+  ==============================================================================
+
+    RealtimeThreadPool.cpp
+
+  ==============================================================================
+*/
+
+#include "RealtimeThreadPool.h"
+#include "RealtimeAllocationCheck.h"
+
+#include <algorithm>
+#include <chrono>
+
+#if defined (__x86_64__) || defined (__i386__) || defined (_M_X64) || defined (_M_IX86)
+ #include <immintrin.h>
+#endif
+#if defined (_WIN32)
+ #ifndef NOMINMAX
+  #define NOMINMAX
+ #endif
+ #ifndef WIN32_LEAN_AND_MEAN
+  #define WIN32_LEAN_AND_MEAN
+ #endif
+ #include <windows.h>
+#elif defined (__APPLE__) || defined (__linux__)
+ #include <pthread.h>
+ #include <sched.h>
+#endif
+
+#define REALTIME_POOL_SPIN_MICROS 20 //how long a worker keeps looking for the next job before it parks
+#define REALTIME_POOL_PAUSES_PER_YIELD 64 //a spinning thread gives the core away this often, see cpuWait
+#define REALTIME_POOL_PARK_TIMEOUT_MS 10 //parked workers look again this often, in case a wakeup was missed
+
+namespace
+{
+    constexpr uint64_t jobMask = (uint64_t { 1 } << 48) - 1;
+
+    uint64_t pack (uint64_t job, int begin, int end) noexcept {
+        return (job << 16) | (static_cast<uint64_t> (begin) << 8) | static_cast<uint64_t> (end);
+    }
+
+    //tells the core (and its hyperthread sibling) we're waiting, without giving up the thread
+    inline void cpuRelax() noexcept {
+       #if defined (__x86_64__) || defined (__i386__) || defined (_M_X64) || defined (_M_IX86)
+        _mm_pause();
+       #elif defined (__aarch64__) || defined (__arm__)
+        __asm__ __volatile__ ("yield");
+       #else
+        std::this_thread::yield();
+       #endif
+    }
+
+    //busy-waiting that never hogs a core: every so often the thread yields, so another runnable thread of the same
+    //priority (another instance's worker holding a task, say) gets the core instead of waiting out our time slice
+    inline void cpuWait (int& pauses) noexcept {
+        if (++pauses % REALTIME_POOL_PAUSES_PER_YIELD == 0)
+            std::this_thread::yield();
+        else
+            cpuRelax();
+    }
+
+    //a low realtime priority: above every normal thread, below the host's audio threads. the OS decides where the
+    //worker runs, so the workers of several instances spread over the cores rather than all landing on the same
+    //few. failures are ignored (Linux only grants realtime scheduling to users allowed to have it)
+    void raisePriority() {
+       #if defined (_WIN32)
+        SetThreadPriority (GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+       #elif defined (__linux__)
+        sched_param param {};
+        param.sched_priority = sched_get_priority_min (SCHED_FIFO) + 1;
+        pthread_setschedparam (pthread_self(), SCHED_FIFO, &param);
+       #elif defined (__APPLE__)
+        pthread_set_qos_class_self_np (QOS_CLASS_USER_INTERACTIVE, 0);
+       #endif
+    }
+}
+
+RealtimeThreadPool::~RealtimeThreadPool() {
+    stop();
+}
+
+void RealtimeThreadPool::start (int numWorkers) {
+    numWorkers = std::clamp (numWorkers, 0, maxTasks - 1);
+    if (numWorkers == getNumWorkers() && queues != nullptr)
+        return;
+
+    stop();
+    numParticipants = numWorkers + 1;
+    queues.reset (new Queue[static_cast<size_t> (numParticipants)]);
+    workers.reserve (static_cast<size_t> (numWorkers));
+    for (int i = 1; i <= numWorkers; ++i)
+        workers.emplace_back ([this, i] { workerLoop (i); });
+}
+
+void RealtimeThreadPool::stop() {
+    if (workers.empty())
+        return;
+
+    {
+        std::lock_guard<std::mutex> guard (parkLock);
+        stopping.store (true, std::memory_order_seq_cst);
+    }
+    wake.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+    workers.clear();
+    stopping.store (false, std::memory_order_relaxed);
+}
+
+void RealtimeThreadPool::runJob (void (*function) (void*, int), void* functionContext, int numTasks) noexcept {
+    if (numTasks <= 0)
+        return;
+
+    //nothing to share: don't bother the workers
+    if (numTasks == 1 || workers.empty() || numTasks > maxTasks) {
+        for (int i = 0; i < numTasks; ++i)
+            function (functionContext, i);
+        return;
+    }
+
+    //deal every participant a contiguous share, then publish the job. the shares are stored after call and context,
+    //so whoever claims a task from one sees them
+    call = function;
+    context = functionContext;
+    const uint64_t job = (currentJob.load (std::memory_order_relaxed) + 1) & jobMask;
+    unfinished.store (numTasks, std::memory_order_relaxed);
+    for (int p = 0; p < numParticipants; ++p)
+        queues[p].tasks.store (pack (job, numTasks * p / numParticipants, numTasks * (p + 1) / numParticipants),
+                               std::memory_order_release);
+    currentJob.store (job, std::memory_order_seq_cst);
+    wakeParkedWorkers();
+
+    //work through our share and steal the rest, then wait only for tasks the workers are already running
+    while (runNextTask (0, job)) {}
+    for (int pauses = 0; unfinished.load (std::memory_order_acquire) > 0;)
+        cpuWait (pauses);
+}
+
+//claims a task of the job, from the participant's own queue first and then from the others', and runs it
+bool RealtimeThreadPool::runNextTask (int participant, uint64_t job) noexcept {
+    int index = 0;
+    bool found = claim (queues[participant], job, true, index);
+    for (int i = 1; ! found && i < numParticipants; ++i)
+        found = claim (queues[(participant + i) % numParticipants], job, false, index);
+    if (! found)
+        return false;
+
+    call (context, index);
+    unfinished.fetch_sub (1, std::memory_order_acq_rel);
+    return true;
+}
+
+//the owner takes from the front and thieves from the back; both are a compare-and-swap on the same word
+bool RealtimeThreadPool::claim (Queue& queue, uint64_t job, bool fromFront, int& index) noexcept {
+    uint64_t tasks = queue.tasks.load (std::memory_order_acquire);
+    for (;;) {
+        const int begin = static_cast<int> ((tasks >> 8) & 0xff);
+        const int end = static_cast<int> (tasks & 0xff);
+        if ((tasks >> 16) != job || begin >= end)
+            return false;
+
+        const uint64_t claimed = fromFront ? pack (job, begin + 1, end) : pack (job, begin, end - 1);
+        if (queue.tasks.compare_exchange_weak (tasks, claimed, std::memory_order_acq_rel, std::memory_order_acquire)) {
+            index = fromFront ? begin : end - 1;
+            return true;
+        }
+    }
+}
+
+void RealtimeThreadPool::wakeParkedWorkers() noexcept {
+    if (numParked.load (std::memory_order_seq_cst) == 0)
+        return;
+
+    //a worker that has checked for work but isn't waiting yet holds the lock. if it's free, every parked worker is
+    //either waiting or will see the job; if not, the worker misses this wakeup and looks again after its timeout,
+    //while we run its share. either way the audio thread never waits for the lock
+    if (parkLock.try_lock())
+        parkLock.unlock();
+    wake.notify_all();
+}
+
+void RealtimeThreadPool::workerLoop (int participant) {
+    raisePriority();
+    uint64_t seen = currentJob.load (std::memory_order_acquire);
+    for (;;) {
+        //spin for the next job for a short while: a block split at ramp ends or MIDI events comes as several jobs
+        //back to back, and picking one up this way takes no system call on either side. the spin yields now and then
+        //and ends soon, since the core may be shared with other instances' workers at the same priority
+        const auto spinUntil = std::chrono::steady_clock::now() + std::chrono::microseconds (REALTIME_POOL_SPIN_MICROS);
+        int pauses = 0;
+        for (int spins = 1; currentJob.load (std::memory_order_acquire) == seen && ! stopping.load (std::memory_order_relaxed); ++spins) {
+            cpuWait (pauses);
+            if (spins % 64 == 0 && std::chrono::steady_clock::now() > spinUntil) {
+                std::unique_lock<std::mutex> guard (parkLock);
+                numParked.fetch_add (1, std::memory_order_seq_cst);
+                while (currentJob.load (std::memory_order_seq_cst) == seen && ! stopping.load (std::memory_order_seq_cst))
+                    wake.wait_for (guard, std::chrono::milliseconds (REALTIME_POOL_PARK_TIMEOUT_MS));
+                numParked.fetch_sub (1, std::memory_order_relaxed);
+            }
+        }
+        if (stopping.load (std::memory_order_relaxed))
+            return;
+
+        //tasks are part of some audio thread's block, so the same no-allocation rule applies to them here
+        RealtimeAllocationCheck::ScopedRealtimeSection realtimeSection;
+        seen = currentJob.load (std::memory_order_acquire);
+        while (runNextTask (participant, seen)) {}
+    }
+}
@@ -0,0 +1,110 @@
+/*
+  ==============================================================================
+
+    RealtimeThreadPool.h
+    Worker threads one instance uses to split a wide bus across cores while
+    playing in realtime.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//==============================================================================
+/**
+    A few worker threads owned by one instance, which its audio thread hands
+    tasks to in the middle of a block. Unlike RenderThreadPool it is built so
+    that run() never blocks on anything but tasks that are already running:
+
+    - every participant (the caller is 0, the workers 1 on) gets a contiguous
+      share of the tasks in its own queue, takes them from the front, and once
+      it runs out steals single tasks from the back of the others'. Claiming is
+      one compare-and-swap, so no participant ever waits for a lock;
+    - the caller doesn't wait for the workers to wake up: if they are late, it
+      steals their shares and runs the whole job itself;
+    - after a job the workers spin for a short while, so the next block's job
+      is picked up without a system call, then park on a condition variable.
+      Waking them from run() takes no lock. Spinning yields the core every so
+      often, so workers of several instances sharing a core at the same
+      priority can't starve each other of the tasks they've claimed.
+
+    Which thread runs a task never changes what it computes, so the output is
+    the same whatever the timing. The workers ask for realtime priority, which
+    the OS may refuse (they still work without it), and are left for the OS to
+    place: pinning worker i to core i would stack every instance's workers on
+    the same cores.
+
+    One thread submits jobs at a time (the instance's audio thread); run() is
+    not reentrant.
+*/
+class RealtimeThreadPool
+{
+public:
+    /** The most tasks one job can have; run() does larger jobs serially. */
+    static constexpr int maxTasks = 255;
+
+    RealtimeThreadPool() = default;
+    ~RealtimeThreadPool();
+
+    /** Runs numWorkers threads from now on, stopping those already running if the
+        count changes. It creates threads, so call it off the audio thread (prepareToPlay
+        does), and never while run() may be called.
+    */
+    void start (int numWorkers);
+
+    /** Stops and joins the workers; run() works alone until the next start(). */
+    void stop();
+
+    /** Threads besides the caller's that run() can hand tasks to. */
+    int getNumWorkers() const noexcept { return static_cast<int> (workers.size()); }
+
+    /** Calls task (i) for every i in [0, numTasks), on the workers and the calling
+        thread, and returns once all of them have returned. Tasks of one job may run
+        in any order and at the same time, so they must not touch the same data.
+        Doesn't allocate or lock.
+    */
+    template <typename Task>
+    void run (int numTasks, Task& task) noexcept {
+        runJob ([] (void* context, int index) { (*static_cast<Task*> (context)) (index); }, &task, numTasks);
+    }
+
+private:
+    //a participant's share of the current job: tasks [begin, end), packed with the job's number into one word so
+    //a claim is a single compare-and-swap, and one for a job that has finished can never succeed
+    struct alignas (64) Queue
+    {
+        std::atomic<uint64_t> tasks { 0 };
+    };
+
+    void runJob (void (*function) (void*, int), void* functionContext, int numTasks) noexcept;
+    bool runNextTask (int participant, uint64_t job) noexcept;
+    bool claim (Queue& queue, uint64_t job, bool fromFront, int& index) noexcept;
+    void wakeParkedWorkers() noexcept;
+    void workerLoop (int participant);
+
+    //the job: only written by run() while no task is left to claim, so a successful claim makes them safe to read
+    void (*call) (void*, int) = nullptr;
+    void* context = nullptr;
+
+    std::unique_ptr<Queue[]> queues;
+    int numParticipants = 1;
+    alignas (64) std::atomic<uint64_t> currentJob { 0 };
+    alignas (64) std::atomic<int> unfinished { 0 };
+
+    std::mutex parkLock;
+    std::condition_variable wake;
+    std::atomic<int> numParked { 0 };
+    std::atomic<bool> stopping { false };
+    std::vector<std::thread> workers;
+
+    RealtimeThreadPool (const RealtimeThreadPool&) = delete;
+    RealtimeThreadPool& operator= (const RealtimeThreadPool&) = delete;
+};
@@ -0,0 +1,119 @@
+/*
+  ==============================================================================
+
+    RenderThreadPool.cpp
+
+  ==============================================================================
+*/
+
+#include "RenderThreadPool.h"
+
+#include <algorithm>
+
+#define RENDER_POOL_MAX_WORKERS 15
+
+RenderThreadPool::~RenderThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard (lock);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+}
+
+std::shared_ptr<RenderThreadPool> RenderThreadPool::getInstance() {
+    static std::mutex instanceLock;
+    static std::weak_ptr<RenderThreadPool> instance;
+
+    std::lock_guard<std::mutex> guard (instanceLock);
+    auto pool = instance.lock();
+    if (pool == nullptr) {
+        pool.reset (new RenderThreadPool());
+        instance = pool;
+    }
+    return pool;
+}
+
+void RenderThreadPool::start() {
+    std::lock_guard<std::mutex> guard (lock);
+    if (! workers.empty())
+        return;
+
+    const int cores = static_cast<int> (std::thread::hardware_concurrency());
+    const int count = std::clamp (cores - 1, 0, RENDER_POOL_MAX_WORKERS);
+    workers.reserve (static_cast<size_t> (count));
+    for (int i = 0; i < count; ++i)
+        workers.emplace_back ([this] { workerLoop(); });
+    numWorkers.store (count, std::memory_order_release);
+}
+
+int RenderThreadPool::getNumWorkers() const noexcept {
+    return numWorkers.load (std::memory_order_acquire);
+}
+
+void RenderThreadPool::runJob (Job& job) {
+    if (job.numTasks <= 0)
+        return;
+
+    //nothing to share: don't bother the workers
+    if (job.numTasks == 1 || getNumWorkers() == 0) {
+        for (int i = 0; i < job.numTasks; ++i)
+            job.call (job.context, i);
+        return;
+    }
+
+    std::unique_lock<std::mutex> guard (lock);
+    job.unfinished = job.numTasks;
+    (lastJob != nullptr ? lastJob->nextJob : firstJob) = &job;
+    lastJob = &job;
+    workAvailable.notify_all();
+
+    //the caller works through its own job alongside the workers, then waits for the tasks they took
+    while (job.nextTask < job.numTasks) {
+        const int index = job.nextTask++;
+        if (job.nextTask == job.numTasks)
+            unlink (job);
+        guard.unlock();
+        job.call (job.context, index);
+        guard.lock();
+        --job.unfinished;
+    }
+    jobFinished.wait (guard, [&job] { return job.unfinished == 0; });
+}
+
+void RenderThreadPool::workerLoop() {
+    std::unique_lock<std::mutex> guard (lock);
+    for (;;) {
+        workAvailable.wait (guard, [this] { return stopping || firstJob != nullptr; });
+        if (stopping)
+            return;
+
+        int index = 0;
+        Job* job = claimTask (index);
+        guard.unlock();
+        job->call (job->context, index);
+        guard.lock();
+        //the job lives in its caller's frame, so this is the last time it's touched here
+        if (--job->unfinished == 0)
+            jobFinished.notify_all();
+    }
+}
+
+RenderThreadPool::Job* RenderThreadPool::claimTask (int& index) noexcept {
+    Job* job = firstJob;
+    index = job->nextTask++;
+    if (job->nextTask == job->numTasks)
+        unlink (*job); //every task is taken: later workers go on to the next job
+    return job;
+}
+
+void RenderThreadPool::unlink (Job& job) noexcept {
+    Job* previous = nullptr;
+    for (Job* j = firstJob; j != nullptr && j != &job; j = j->nextJob)
+        previous = j;
+    (previous != nullptr ? previous->nextJob : firstJob) = job.nextJob;
+    if (lastJob == &job)
+        lastJob = previous;
+    job.nextJob = nullptr;
+}
@@ -0,0 +1,89 @@
+/*
+  ==============================================================================
+
+    RenderThreadPool.h
+    Process-wide worker threads for spreading offline renders over the cores.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//==============================================================================
+/**
+    A handful of worker threads (one fewer than the machine has cores) shared
+    by every instance in the process, reference counted like DelayBufferPool.
+    run() splits a job into numbered tasks, hands them to the workers and works
+    on them itself too, and returns once every task is done. Several instances
+    can run jobs at once; the workers take them in the order they arrive.
+
+    The threads sleep on a condition variable between jobs and take a lock to
+    pick up each task, so the pool is for offline renders, where a few
+    microseconds per handoff don't matter and the tasks are long. run() doesn't
+    allocate.
+*/
+class RenderThreadPool
+{
+public:
+    ~RenderThreadPool();
+
+    /** The shared pool, created for the first user. */
+    static std::shared_ptr<RenderThreadPool> getInstance();
+
+    /** Starts the workers if they aren't running yet. It creates threads, so call it
+        off the audio thread (prepareToPlay does); until then run() works alone.
+    */
+    void start();
+
+    /** Threads besides the caller's that run() can hand tasks to. */
+    int getNumWorkers() const noexcept;
+
+    /** Calls task (i) for every i in [0, numTasks), on the workers and the calling
+        thread, and returns once all of them have returned. Tasks of one job may run
+        in any order and at the same time, so they must not touch the same data.
+    */
+    template <typename Task>
+    void run (int numTasks, Task& task) {
+        Job job;
+        job.call = [] (void* context, int index) { (*static_cast<Task*> (context)) (index); };
+        job.context = &task;
+        job.numTasks = numTasks;
+        runJob (job);
+    }
+
+private:
+    struct Job
+    {
+        void (*call) (void*, int) = nullptr;
+        void* context = nullptr;
+        int numTasks = 0;
+        int nextTask = 0;       //all guarded by the pool's lock
+        int unfinished = 0;
+        Job* nextJob = nullptr; //the queue is a list through the callers' stack frames, so queueing never allocates
+    };
+
+    RenderThreadPool() = default;
+
+    void runJob (Job& job);
+    void workerLoop();
+    Job* claimTask (int& index) noexcept;  //the lock must be held
+    void unlink (Job& job) noexcept;       //the lock must be held
+
+    std::mutex lock;
+    std::condition_variable workAvailable, jobFinished;
+    Job* firstJob = nullptr;
+    Job* lastJob = nullptr;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+    std::atomic<int> numWorkers { 0 };
+
+    RenderThreadPool (const RenderThreadPool&) = delete;
+    RenderThreadPool& operator= (const RenderThreadPool&) = delete;
+};
@@ -0,0 +1,78 @@
+/*
+  ==============================================================================
+
+    SampleFormat.h
+    Storage formats a DelayLine can keep its samples in.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+//==============================================================================
+/** How a delay line stores its samples. The 16-bit formats halve the memory
+    and bandwidth of a line at the cost of precision.
+*/
+enum class SampleFormat
+{
+    float32 = 0,    //exact
+    int16,          //fixed point with 12 dB of headroom above full scale (~84 dB SNR)
+    bfloat16        //the top half of a float: full range, 8 bits of mantissa (~48 dB SNR)
+};
+
+inline int getBytesPerSample (SampleFormat format) noexcept {
+    return format == SampleFormat::float32 ? 4 : 2;
+}
+
+//==============================================================================
+/*
+    One codec per format. encode/decode are tiny, branch-free and inline, so the
+    DelayLine kernels that are templated on them vectorise the conversion
+    together with the rest of the loop.
+*/
+struct Float32Codec
+{
+    using Stored = float;
+    static constexpr SampleFormat format = SampleFormat::float32;
+
+    static inline Stored encode (float x) noexcept  { return x; }
+    static inline float decode (Stored s) noexcept  { return s; }
+};
+
+struct Int16Codec
+{
+    using Stored = int16_t;
+    static constexpr SampleFormat format = SampleFormat::int16;
+    static constexpr float fullScale = 4.0f;
+
+    static inline Stored encode (float x) noexcept {
+        const float scaled = std::clamp (x * (32767.0f / fullScale), -32768.0f, 32767.0f);
+        return static_cast<Stored> (scaled + (scaled >= 0.0f ? 0.5f : -0.5f));
+    }
+
+    static inline float decode (Stored s) noexcept  { return static_cast<float> (s) * (fullScale / 32767.0f); }
+};
+
+struct BFloat16Codec
+{
+    using Stored = uint16_t;
+    static constexpr SampleFormat format = SampleFormat::bfloat16;
+
+    static inline Stored encode (float x) noexcept {
+        uint32_t bits;
+        std::memcpy (&bits, &x, sizeof (bits));
+        bits += 0x7fffu + ((bits >> 16) & 1u); //round to nearest even
+        return static_cast<Stored> (bits >> 16);
+    }
+
+    static inline float decode (Stored s) noexcept {
+        const uint32_t bits = static_cast<uint32_t> (s) << 16;
+        float x;
+        std::memcpy (&x, &bits, sizeof (x));
+        return x;
+    }
+};
@@ -0,0 +1,77 @@
+/*
+  ==============================================================================
+
+    SmoothedParameter.h
+    Linear ramp used to read automatable parameters on the audio thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+
+//==============================================================================
+/**
+    Ramps linearly from its current value to a target over a fixed number of
+    samples. Everything is plain arithmetic on floats so it can live on the audio
+    thread; the caller hands it the latest target (usually loaded from an atomic
+    parameter) once per block.
+
+    Rather than being ticked per sample, a block is split where the ramp ends:
+    getNumSamplesAtCurrentStep() says how far the current slope is valid, the
+    kernel applies value + step * i over that span, and skip() moves past it.
+*/
+class SmoothedParameter
+{
+public:
+    SmoothedParameter() = default;
+
+    /** Sets how many samples a full ramp takes and snaps to the target. */
+    void reset (double sampleRate, double rampLengthSeconds) noexcept {
+        rampLength = std::max (1, static_cast<int> (sampleRate * rampLengthSeconds));
+        setCurrentAndTarget (target);
+    }
+
+    void setCurrentAndTarget (float newValue) noexcept {
+        current = target = newValue;
+        step = 0.0f;
+        countdown = 0;
+    }
+
+    /** Starts a new ramp from wherever the value is now, if the target moved. */
+    void setTarget (float newTarget) noexcept {
+        if (newTarget == target)
+            return;
+
+        target = newTarget;
+        countdown = rampLength;
+        step = (target - current) / static_cast<float> (rampLength);
+    }
+
+    float getCurrentValue() const noexcept          { return current; }
+    float getTargetValue() const noexcept           { return target; }
+    float getStep() const noexcept                  { return step; }
+    bool isSmoothing() const noexcept               { return countdown > 0; }
+
+    /** How many of the next numSamples samples follow the current slope. */
+    int getNumSamplesAtCurrentStep (int numSamples) const noexcept {
+        return countdown > 0 ? std::min (numSamples, countdown) : numSamples;
+    }
+
+    /** Advances by numSamples, which must not exceed getNumSamplesAtCurrentStep(). */
+    void skip (int numSamples) noexcept {
+        if (countdown <= 0)
+            return;
+
+        countdown -= numSamples;
+        if (countdown <= 0)
+            setCurrentAndTarget (target);
+        else
+            current += step * static_cast<float> (numSamples);
+    }
+
+private:
+    float current = 0.0f, target = 0.0f, step = 0.0f;
+    int countdown = 0, rampLength = 1;
+};
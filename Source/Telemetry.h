@@ -0,0 +1,85 @@
+/*
+  ==============================================================================
+
+    Telemetry.h
+    Lock-free channel from the audio thread to the editor.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <array>
+#include <atomic>
+
+//==============================================================================
+/** What the audio thread reports about one block. */
+struct TelemetryFrame
+{
+    float blockSeconds = 0.0f;  //length of the block
+    float inputPeak = 0.0f;     //across all channels
+    float outputPeak = 0.0f;    //dry plus echo
+    float linePeak = 0.0f;      //across all channels: what the block wrote into the line of the current mode. side by
+                                //side, these are a decimated copy of the line's contents (what the scope draws)
+    float feedback = 0.0f;
+    float delaySeconds = 0.0f;
+    int mode = 0;
+    size_t memoryBytes = 0;
+};
+
+//==============================================================================
+/**
+    Single producer (the audio thread), single consumer (the editor's timer)
+    queue of TelemetryFrames, built on juce::AbstractFifo.
+
+    The audio thread only does any work while a consumer is attached, so an
+    instance whose editor is closed pays one relaxed atomic load per block. push()
+    never blocks or allocates; if the editor falls behind, frames are dropped.
+*/
+class TelemetryFifo
+{
+public:
+    static constexpr int capacity = 512; //about 1.3 s of 128-sample blocks at 48 kHz
+
+    TelemetryFifo() = default;
+
+    /** Message thread: the editor attaches on open and detaches on close. */
+    void setConsumerActive (bool shouldBeActive) noexcept {
+        if (shouldBeActive) //drop whatever an earlier editor left behind, from the consumer side
+            fifo.finishedRead (fifo.getNumReady());
+        consumerActive.store (shouldBeActive, std::memory_order_release);
+    }
+
+    /** Audio thread: whether it's worth measuring anything for push(). */
+    bool isConsumerActive() const noexcept { return consumerActive.load (std::memory_order_acquire); }
+
+    /** Audio thread. Returns false if the frame was dropped. */
+    bool push (const TelemetryFrame& frame) noexcept {
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite (1, start1, size1, start2, size2);
+        if (size1 + size2 < 1)
+            return false;
+        frames[static_cast<size_t> (size1 > 0 ? start1 : start2)] = frame;
+        fifo.finishedWrite (1);
+        return true;
+    }
+
+    /** Consumer: copies up to maxFrames of the oldest frames into dest and returns how many. */
+    int pop (TelemetryFrame* dest, int maxFrames) noexcept {
+        int start1, size1, start2, size2;
+        fifo.prepareToRead (maxFrames, start1, size1, start2, size2);
+        std::copy_n (frames.begin() + start1, size1, dest);
+        std::copy_n (frames.begin() + start2, size2, dest + size1);
+        fifo.finishedRead (size1 + size2);
+        return size1 + size2;
+    }
+
+private:
+    juce::AbstractFifo fifo { capacity };
+    std::array<TelemetryFrame, capacity> frames;
+    std::atomic<bool> consumerActive { false };
+
+    JUCE_DECLARE_NON_COPYABLE (TelemetryFifo)
+};